@@ -8,11 +8,11 @@
 ### Tools
 ###-----------------------------------------------------------------------------
 
-CC = gcc-4.8 -std=c99 -D_GNU_SOURCE -m32
+CC = gcc-4.8 -std=c99 -D_GNU_SOURCE
 CXX = g++ -std = c++11
 CPP = gcc -E
 
-#CC = clang -std = c99 -D_GNU_SOURCE -m32
+#CC = clang -std = c99 -D_GNU_SOURCE
 #CXX = clang++ -std = c++11
 #CPP = clang -E
 
@@ -0,0 +1,1785 @@
+/// Copyright 1993-2015 Timothy A. Budd
+// -----------------------------------------------------------------------------
+//  This file is part of
+/// ---     Leda: Multiparadigm Programming Language
+// -----------------------------------------------------------------------------
+//
+//  Leda is free software: you can redistribute it and/or modify it under the
+//  terms of the MIT license, see file "COPYING" included in this distribution.
+//
+// -----------------------------------------------------------------------------
+/// Title: Evaluator for the Leda interpreter
+///  Description:
+//    Included twice by interp.c, so there is no include guard.
+//    With TRACE defined as 0 it is the production evaluator and the
+//    display tests compile away, with TRACE defined as 1 (and the entry
+//    points renamed) it is the evaluator used for -df, -ds and -do.
+// -----------------------------------------------------------------------------
+
+static struct ledaValue* evaluateStatement(struct statementRecord* s);
+static struct ledaValue* evaluateExpression(struct expressionRecord* e);
+static struct ledaValue* evaluateSpecial
+(
+    int index,
+    int nargs,
+    struct expressionRecord** args
+);
+
+
+// -----------------------------------------------------------------------------
+///  Calls made by cfunctions
+// -----------------------------------------------------------------------------
+
+//- Calls the function value fun with two arguments.  The collector may
+//  run, so callers must protect any values they hold
+static struct ledaValue* applyFunction
+(
+    struct ledaValue* fun,
+    struct ledaValue* left,
+    struct ledaValue* right
+)
+{
+    struct ledaValue* code = fun->data[2];
+    struct ledaValue* frameMark = framePointer;
+
+    rootStack[rootTop++] = fun;
+    rootStack[rootTop++] = left;
+    rootStack[rootTop++] = right;
+    struct ledaValue* newContext = newActivationRecord(code, 6);
+    right = rootStack[--rootTop];
+    left = rootStack[--rootTop];
+    fun = rootStack[--rootTop];
+
+    newContext->data[1] = fun->data[1];
+    newContext->data[2] = currentContext;
+
+    // Arguments are stored last first
+    newContext->data[4] = right;
+    newContext->data[5] = left;
+    currentContext = newContext;
+
+    struct ledaValue* result;
+    struct expressionRecord* primitive = TRACE ? 0 : primitiveBody(code);
+    if (primitive)
+    {
+        result = evaluateSpecial
+        (
+            primitive->u.c.index,
+            primitive->u.c.nargs,
+            primitive->u.c.args
+        );
+    }
+    else
+    {
+        result = evaluateStatement((struct statementRecord*) code);
+    }
+
+    currentContext = currentContext->data[2];
+    framePointer = frameMark;
+
+    return result;
+}
+
+
+//- Integers and strings in their natural order are compared directly,
+//  anything else by the comparator at rootStack[base + 2]
+static int sortLess
+(
+    int base,
+    int natural,
+    struct ledaValue* x,
+    struct ledaValue* y
+)
+{
+    if (natural && x && y && (x->data[0] == y->data[0]))
+    {
+        if (x->data[0] == integerClass)
+        {
+            return intValue(x) < intValue(y);
+        }
+        if (x->data[0] == stringClass)
+        {
+            return strcmp((char*) x->data[2], (char*) y->data[2]) < 0;
+        }
+    }
+
+    return applyFunction(rootStack[base + 2], x, y) == trueObject;
+}
+
+
+//- Stable merge sort of the block at rootStack[base], using the block
+//  of the same size at rootStack[base + 1].  Elements are found by
+//  index after every comparison, as the comparator may move the blocks.
+//  Returns the root stack position of the sorted block
+static int sortSlots(int base, int natural)
+{
+    int count = rootStack[base]->size >> 2;
+    int from = base;
+    int to = base + 1;
+
+    for (int width = 1; width < count; width *= 2)
+    {
+        for (int low = 0; low < count; low += 2 * width)
+        {
+            int middle = (low + width < count) ? low + width : count;
+            int high = (low + 2 * width < count) ? low + 2 * width : count;
+            int i = low;
+            int j = middle;
+
+            for (int k = low; k < high; k++)
+            {
+                int takeRight =
+                    (i >= middle)
+                 || (
+                        (j < high)
+                     && sortLess
+                        (
+                            base, natural,
+                            rootStack[from]->data[j],
+                            rootStack[from]->data[i]
+                        )
+                    );
+                rootStack[to]->data[k] =
+                    rootStack[from]->data[takeRight ? j++ : i++];
+            }
+        }
+
+        int t = from;
+        from = to;
+        to = t;
+    }
+
+    return from;
+}
+
+
+//- A PriorityQueue (see std.led) is a binary heap of elements in the
+//  block at rootStack[base].  The unboxed block at rootStack[base + 1]
+//  holds a key and a sequence number for each element, in a pair of
+//  int cells.  Elements are ordered by the comparator at
+//  rootStack[base + 2] if there is one, then by key, then by sequence
+static int* heapCell(int base, int i)
+{
+    return intCells(rootStack[base + 1]) + 2 * i;
+}
+
+
+static int heapLess(int base, int i, int j)
+{
+    if (rootStack[base + 2])
+    {
+        struct ledaValue* x = rootStack[base]->data[i];
+        struct ledaValue* y = rootStack[base]->data[j];
+        if (applyFunction(rootStack[base + 2], x, y) == trueObject)
+        {
+            return 1;
+        }
+        x = rootStack[base]->data[i];
+        y = rootStack[base]->data[j];
+        if (applyFunction(rootStack[base + 2], y, x) == trueObject)
+        {
+            return 0;
+        }
+    }
+
+    int* ci = heapCell(base, i);
+    int* cj = heapCell(base, j);
+    if (ci[0] != cj[0])
+    {
+        return ci[0] < cj[0];
+    }
+    return ci[1] < cj[1];
+}
+
+
+static void heapSwap(int base, int i, int j)
+{
+    struct ledaValue* t = rootStack[base]->data[i];
+    rootStack[base]->data[i] = rootStack[base]->data[j];
+    rootStack[base]->data[j] = t;
+
+    int* ci = heapCell(base, i);
+    int* cj = heapCell(base, j);
+    for (int k = 0; k < 2; k++)
+    {
+        int c = ci[k];
+        ci[k] = cj[k];
+        cj[k] = c;
+    }
+}
+
+
+static void heapSiftUp(int base, int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!heapLess(base, i, parent))
+        {
+            break;
+        }
+        heapSwap(base, i, parent);
+        i = parent;
+    }
+}
+
+
+static void heapSiftDown(int base, int i, int count)
+{
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= count)
+        {
+            break;
+        }
+        if ((child + 1 < count) && heapLess(base, child + 1, child))
+        {
+            child++;
+        }
+        if (!heapLess(base, child, i))
+        {
+            break;
+        }
+        heapSwap(base, i, child);
+        i = child;
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+///  Evaluate expressions
+// -----------------------------------------------------------------------------
+
+static struct ledaValue* evaluateSpecial
+(
+    int index,
+    int nargs,
+    struct expressionRecord** args
+)
+{
+    struct ledaValue* result = 0;
+    struct ledaValue* a;
+    struct ledaValue* b;
+    float r1;
+
+    switch(index) {
+        case 0:     // object equality
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            if (a == b)
+                result = trueObject;
+            else
+                result = falseObject;
+            break;
+
+        case 1:     // string compare
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            result = newIntegerConstant
+            (
+                strcmp((char*) a->data[2],
+                (char*) b->data[2])
+            );
+            break;
+
+        case 2:     // string print
+            result = evaluateExpression(*args);
+            fputs((char*) result->data[2], stdout);
+            result = 0;
+            break;
+
+        case 3:     // string concat
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            {
+                char* buffer =
+                    (char*)malloc
+                    (
+                        strlen((char*) a->data[2])
+                      + strlen((char*) b->data[2])
+                      + 1
+                    );
+                if (buffer == 0)
+                {
+                    yyerror("out of memory");
+                }
+                strcpy(buffer, (char*) a->data[2]);
+                strcat(buffer, (char*) b->data[2]);
+                result = newStringConstant(buffer);
+            }
+            break;
+
+        case 4:     // integer equals
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            if (intValue(a) == intValue(b))
+            {
+                result = trueObject;
+            }
+            else
+            {
+                result = falseObject;
+            }
+            break;
+
+        case 5:     // integer add
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            result = newIntegerConstant
+            (
+                intValue(a) + intValue(b)
+            );
+            break;
+
+        case 6:     // integer minus
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            result = newIntegerConstant
+            (
+                intValue(a) - intValue(b)
+            );
+            break;
+
+        case 7:     // integer times
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            result = newIntegerConstant
+            (
+                intValue(a) * intValue(b)
+            );
+            break;
+
+        case 8:     // integer division
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            result = newIntegerConstant
+            (
+                intValue(a)/intValue(b)
+            );
+            break;
+
+        case 9:     // integer as string
+            {
+                char buffer[40];
+                result = evaluateExpression(*args);
+                int length = formatInteger(buffer, intValue(result));
+                result = newStringConstant(formattedString(buffer, length));
+            }
+            break;
+
+        case 10:    // integer less
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            if (intValue(a) < intValue(b))
+            {
+                result = trueObject;
+            }
+            else
+            {
+                result = falseObject;
+            }
+            break;
+
+        case 11:    // integer or
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            result = newIntegerConstant
+            (
+                intValue(a) | intValue(b)
+            );
+            break;
+
+        case 12:    // integer and
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            a = rootStack[--rootTop];
+            result = newIntegerConstant
+            (
+                intValue(a) & intValue(b)
+            );
+            break;
+
+        case 13:    // integer invert
+            a = evaluateExpression(*args);
+            result = newIntegerConstant(~ intValue(a));
+            break;
+
+        case 14:        // integer as real
+            a = evaluateExpression(*args);
+            result = newRealConstant((float) intValue(a));
+            break;
+
+        case 15:        // allocate new object
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            args++;
+            result = gcalloc(intValue(a));
+            a = rootStack[--rootTop];
+            // now fill in any argument values, the rest start out NIL
+            for (int i = 0; i < (result->size >> 2); i++)
+            {
+                result->data[i] = 0;
+            }
+            for (int i = 0; i < nargs - 1; i++)
+            {
+                rootStack[rootTop++] = result;
+                a = evaluateExpression(args[i]);
+                result = rootStack[--rootTop];
+                result->data[i] = a;
+            }
+            break;
+
+        case 16:        // index at
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            undefCheck(1, a, "subscript base");
+            args++;
+            b = evaluateExpression(*args);
+            undefCheck(2, b, "subscript index");
+            a = rootStack[--rootTop];
+            result = a->data[intValue(b)];
+            break;
+
+        case 17:    // index at put
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            a = evaluateExpression(*args);
+            undefCheck(3, a, "subscript base");
+            args++;
+            b = evaluateExpression(*args);
+            undefCheck(4, b, "subscript index");
+            rootStack[rootTop++] = b;
+            {
+                struct ledaValue* c;
+                args++;
+                c = evaluateExpression(*args);
+                b = rootStack[--rootTop];
+                a = rootStack[--rootTop];
+                a->data[intValue(b)] = c;
+            }
+            result = 0;
+            break;
+
+        case 18:    // just evaluate value
+            result = evaluateExpression(*args);
+            break;
+
+        case 19:    // string length
+            a = evaluateExpression(*args);
+            undefCheck(5, a, "string length");
+            result = newIntegerConstant(strlen((char*) a->data[2]));
+            break;
+
+        case 20:    // string substring
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            undefCheck(6, a, "substring base");
+            args++;
+            b = evaluateExpression(*args);
+            rootStack[rootTop++] = b;
+            undefCheck(7, b, "substring start");
+            {
+                args++;
+                struct ledaValue* c = evaluateExpression(*args);
+                undefCheck(8, c, "substring length");
+                char* buffer = (char*) malloc(1 + intValue(c));
+                char* p = buffer;
+                if (buffer == 0)
+                {
+                    yyerror("out of memory");
+                }
+                b = rootStack[--rootTop];
+                a = rootStack[--rootTop];
+                char* q = (char*) a->data[2];
+                int i;
+                for (q = &q[intValue(b)], i = intValue(c); i > 0; i--)
+                {
+                    *p++ = *q++;
+                }
+                *p = '\0';
+                result = newStringConstant(buffer);
+            }
+            break;
+
+        case 21:    // stdin read
+            {
+                char buffer[256];
+                if (fgets(buffer, sizeof(buffer), stdin) == 0)
+                {
+                    result = 0;
+                }
+                else
+                {
+                    result = newStringConstant(newString(buffer));
+                }
+            }
+            break;
+
+        case 22:    // is defined
+            a = evaluateExpression(*args);
+            if (a)
+                result = trueObject;
+            else
+                result = falseObject;
+            break;
+
+
+        case 23:    // real as string
+        case 75:    // real as exact string
+            {
+                char buffer[40];
+                result = evaluateExpression(*args);
+                int length =
+                    formatReal(buffer, realValue(result), index == 75);
+                result = newStringConstant(formattedString(buffer, length));
+            }
+            break;
+
+        case 24:    // real addition
+            a = evaluateExpression(*args);
+            r1 = realValue(a);
+            args++;
+            b = evaluateExpression(*args);
+            result = newRealConstant(r1 + realValue(b));
+            break;
+
+        case 25:    // real subtraction
+            a = evaluateExpression(*args);
+            r1 = realValue(a);
+            args++;
+            b = evaluateExpression(*args);
+            result = newRealConstant(r1 - realValue(b));
+            break;
+
+        case 26:    // real multiplication
+            a = evaluateExpression(*args);
+            r1 = realValue(a);
+            args++;
+            b = evaluateExpression(*args);
+            result = newRealConstant(r1 * realValue(b));
+            break;
+
+
+        case 27:    // real division
+            a = evaluateExpression(*args);
+            r1 = realValue(a);
+            args++;
+            b = evaluateExpression(*args);
+            result = newRealConstant(r1 / realValue(b));
+            break;
+
+        case 28:    // real comparison
+            a = evaluateExpression(*args);
+            r1 = realValue(a);
+            args++;
+            b = evaluateExpression(*args);
+            if (r1 < realValue(b))
+            {
+                result = trueObject;
+            }
+            else
+            {
+                result = falseObject;
+            }
+            break;
+
+        case 29:    // real as integer
+            a = evaluateExpression(*args);
+            result = newIntegerConstant((int) realValue(a));
+            break;
+
+        case 30:    // real equality
+            a = evaluateExpression(*args);
+            r1 = realValue(a);
+            args++;
+            b = evaluateExpression(*args);
+            if (r1 == realValue(b))
+            {
+                result = trueObject;
+            }
+            else
+            {
+                result = falseObject;
+            }
+            break;
+
+        case 31:    // string hash
+            a = evaluateExpression(*args);
+            undefCheck(31, a, "string hash");
+            result = newIntegerConstant(stringHash((char*) a->data[2]));
+            break;
+
+        case 32:    // hash table find
+            a = evaluateExpression(*args);
+            undefCheck(32, a, "hash table keys");
+            rootStack[rootTop++] = a;
+            args++;
+            b = evaluateExpression(*args);
+            rootStack[rootTop++] = b;
+            args++;
+            {
+                struct ledaValue* key = evaluateExpression(*args);
+                undefCheck(33, key, "hash table key");
+                rootStack[rootTop++] = key;
+                args++;
+                struct ledaValue* position = evaluateExpression(*args);
+                key = rootStack[--rootTop];
+                b = rootStack[--rootTop];
+                a = rootStack[--rootTop];
+                result = newIntegerConstant
+                (
+                    hashFind(a, intValue(b), key, intValue(position))
+                );
+            }
+            break;
+
+        case 33:    // copy slots: destination, start, source, start, count
+            for (int i = 0; i < 5; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= 5;
+            a = rootStack[rootTop];
+            b = rootStack[rootTop + 2];
+            undefCheck(34, a, "copy destination");
+            undefCheck(35, b, "copy source");
+            memmove
+            (
+                &a->data[intValue(rootStack[rootTop + 1])],
+                &b->data[intValue(rootStack[rootTop + 3])],
+                intValue(rootStack[rootTop + 4]) * sizeof(struct ledaValue*)
+            );
+            result = 0;
+            break;
+
+        case 34:    // sort: block, start, count, comparator, natural order
+            for (int i = 0; i < 5; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= 5;
+            undefCheck(36, rootStack[rootTop], "sort block");
+            {
+                int base = rootTop;
+                int start = intValue(rootStack[base + 1]);
+                int count = intValue(rootStack[base + 2]);
+                int natural = (rootStack[base + 4] == trueObject);
+                if (count < 2)
+                {
+                    break;
+                }
+
+                // Work blocks, then the comparator above them
+                rootTop += 5;
+                for (int w = 0; w < 2; w++)
+                {
+                    a = gcalloc(count);
+                    for (int i = 0; i < count; i++)
+                    {
+                        a->data[i] = 0;
+                    }
+                    rootStack[rootTop++] = a;
+                }
+                memcpy
+                (
+                    rootStack[base + 5]->data,
+                    &rootStack[base]->data[start],
+                    count * sizeof(struct ledaValue*)
+                );
+                rootStack[rootTop++] = rootStack[base + 3];
+
+                int sorted = sortSlots(base + 5, natural);
+                memcpy
+                (
+                    &rootStack[base]->data[start],
+                    rootStack[sorted]->data,
+                    count * sizeof(struct ledaValue*)
+                );
+                rootTop = base;
+            }
+            break;
+
+        case 35:    // fill: block, start, count, value
+            for (int i = 0; i < 4; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= 4;
+            a = rootStack[rootTop];
+            undefCheck(37, a, "fill block");
+            {
+                int start = intValue(rootStack[rootTop + 1]);
+                int count = intValue(rootStack[rootTop + 2]);
+                for (int i = start; i < start + count; i++)
+                {
+                    a->data[i] = rootStack[rootTop + 3];
+                }
+            }
+            break;
+
+        case 36:    // reverse: block, start, count
+            a = evaluateExpression(*args);
+            undefCheck(38, a, "reverse block");
+            rootStack[rootTop++] = a;
+            b = evaluateExpression(args[1]);
+            rootStack[rootTop++] = b;
+            {
+                struct ledaValue* c = evaluateExpression(args[2]);
+                b = rootStack[--rootTop];
+                a = rootStack[--rootTop];
+                int i = intValue(b);
+                int j = i + intValue(c) - 1;
+                for (; i < j; i++, j--)
+                {
+                    struct ledaValue* t = a->data[i];
+                    a->data[i] = a->data[j];
+                    a->data[j] = t;
+                }
+            }
+            break;
+
+        case 37:    // index of: block, start, count, value
+            for (int i = 0; i < 4; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= 4;
+            a = rootStack[rootTop];
+            b = rootStack[rootTop + 3];
+            undefCheck(39, a, "index block");
+            {
+                int start = intValue(rootStack[rootTop + 1]);
+                int count = intValue(rootStack[rootTop + 2]);
+                int native = b && isNativeKey(b);
+                int found = -1;
+                for (int i = start; (found < 0) && (i < start + count); i++)
+                {
+                    struct ledaValue* x = a->data[i];
+                    if
+                    (
+                        (x == b)
+                     || (native && x && (x->data[0] == b->data[0])
+                            && sameNativeKey(x, b))
+                    )
+                    {
+                        found = i - start;
+                    }
+                }
+                result = newIntegerConstant(found);
+            }
+            break;
+
+        case 38: case 39: case 40: case 41: case 42: case 43: case 44:
+        case 45: case 46: case 47: case 48: case 49: case 50: case 51:
+        case 52: case 53: case 54: case 55: case 56: case 76:
+            // unboxed arrays
+            for (int i = 0; i < nargs; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= nargs;
+            result = unboxedOperation(index, &rootStack[rootTop]);
+            break;
+
+        case 57:    // heap add: data, order, comparator, count, value,
+                    // key, sequence
+            for (int i = 0; i < 7; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= 7;
+            undefCheck(42, rootStack[rootTop], "queue elements");
+            undefCheck(52, rootStack[rootTop + 5], "queue key");
+            undefCheck(53, rootStack[rootTop + 6], "queue sequence");
+            {
+                int base = rootTop;
+                int count = intValue(rootStack[base + 3]);
+                int* cell = heapCell(base, count);
+                rootStack[base]->data[count] = rootStack[base + 4];
+                cell[0] = intValue(rootStack[base + 5]);
+                cell[1] = intValue(rootStack[base + 6]);
+                rootTop += 3;
+                heapSiftUp(base, count);
+                rootTop = base;
+            }
+            break;
+
+        case 58:    // heap remove first: data, order, comparator, count
+            for (int i = 0; i < 4; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= 4;
+            undefCheck(43, rootStack[rootTop], "queue elements");
+            {
+                int base = rootTop;
+                int count = intValue(rootStack[base + 3]) - 1;
+                a = rootStack[base];
+                rootStack[base + 3] = a->data[0];
+                if (count > 0)
+                {
+                    heapSwap(base, 0, count);
+                }
+                a->data[count] = 0;
+                rootTop += 4;
+                heapSiftDown(base, 0, count);
+                result = rootStack[base + 3];
+                rootTop = base;
+            }
+            break;
+
+        case 59: case 60: case 61: case 62: case 63: case 64: case 65:
+        case 66:
+            // random numbers
+            for (int i = 0; i < nargs; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= nargs;
+            result = randomOperation(index, &rootStack[rootTop]);
+            break;
+
+        case 67:    // string break: text, start, stop characters
+        case 68:    // string span: text, start, characters
+        case 69:    // string character in: text, start, characters
+        case 70:    // string match at: text, start, pattern
+            for (int i = 0; i < 3; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            rootTop -= 3;
+            undefCheck(45, rootStack[rootTop], "pattern text");
+            undefCheck(46, rootStack[rootTop + 2], "pattern characters");
+            {
+                char* text = (char*) rootStack[rootTop]->data[2];
+                int start = intValue(rootStack[rootTop + 1]);
+                char* chars = (char*) rootStack[rootTop + 2]->data[2];
+                int length = strlen(text);
+                if ((start < 0) || (start > length))
+                {
+                    start = length;
+                }
+                if (index == 67)
+                {
+                    result =
+                        newIntegerConstant(start + strcspn(&text[start], chars));
+                }
+                else if (index == 68)
+                {
+                    result =
+                        newIntegerConstant(start + strspn(&text[start], chars));
+                }
+                else if (index == 69)
+                {
+                    result = (text[start] && strchr(chars, text[start]))
+                        ? trueObject : falseObject;
+                }
+                else
+                {
+                    int n = strlen(chars);
+                    result = (start + n <= length)
+                          && (strncmp(&text[start], chars, n) == 0)
+                        ? trueObject : falseObject;
+                }
+            }
+            break;
+
+        case 71:    // token count: text, separators
+            a = evaluateExpression(*args);
+            rootStack[rootTop++] = a;
+            undefCheck(47, a, "token text");
+            b = evaluateExpression(args[1]);
+            undefCheck(48, b, "token separators");
+            a = rootStack[--rootTop];
+            {
+                char* text = (char*) a->data[2];
+                int count = 0;
+                int end = 0;
+                while (nextToken(text, end, (char*) b->data[2], &end) >= 0)
+                {
+                    count++;
+                }
+                result = newIntegerConstant(count);
+            }
+            break;
+
+        case 72:    // tokens: text, separators, block for the tokens
+            for (int i = 0; i < 3; i++)
+            {
+                rootStack[rootTop++] = evaluateExpression(args[i]);
+            }
+            undefCheck(60, rootStack[rootTop - 3], "token text");
+            undefCheck(61, rootStack[rootTop - 2], "token separators");
+            undefCheck(49, rootStack[rootTop - 1], "token block");
+            {
+                char* text = (char*) rootStack[rootTop - 3]->data[2];
+                char* separators = (char*) rootStack[rootTop - 2]->data[2];
+                int size = rootStack[rootTop - 1]->size >> 2;
+                int end = 0;
+                int start;
+                for
+                (
+                    int i = 0;
+                    (start = nextToken(text, end, separators, &end)) >= 0;
+                    i++
+                )
+                {
+                    if (i >= size)
+                    {
+                        yyerror("more tokens than the token block can hold");
+                    }
+                    char* word = (char*) malloc(1 + end - start);
+                    if (word == 0)
+                    {
+                        yyerror("out of memory");
+                    }
+                    memcpy(word, &text[start], end - start);
+                    word[end - start] = '\0';
+                    a = newStringConstant(word);
+                    rootStack[rootTop - 1]->data[i] = a;
+                }
+            }
+            rootTop -= 3;
+            result = 0;
+            break;
+
+        case 73:    // integer print
+        case 74:    // real print
+            {
+                char buffer[40];
+                a = evaluateExpression(*args);
+                int length = (index == 73)
+                    ? formatInteger(buffer, intValue(a))
+                    : formatReal(buffer, realValue(a), 0);
+                fwrite(buffer, 1, length, stdout);
+            }
+            result = 0;
+            break;
+
+        default:
+            printf("unimplemented special %d\n", index);
+            exit(1);
+            break;
+    }
+
+    return result;
+}
+
+
+static struct ledaValue* evaluateExpression
+(
+    struct expressionRecord* e
+)
+{
+    register struct ledaValue* result;
+    register struct ledaValue* arg;
+
+    if (e == 0)
+    {
+        yyerror("internal run-time error: null expression");
+    }
+
+    switch(e->operator)
+    {
+
+        case getCurrentContext:
+            if (TRACE && displayOperators)
+            {
+                printf("getCurrentContext yields %p\n", currentContext);
+            }
+            return currentContext;
+            break;
+
+        case getOffset:
+            if (e->u.o.base->operator == getCurrentContext)
+            {
+                arg = currentContext;
+            }
+            else
+            {
+                arg = evaluateExpression(e->u.o.base);
+                undefCheck(9, arg, e->u.o.symbol);
+            }
+            result = arg->data[e->u.o.location];
+            if (TRACE && displayOperators)
+            {
+                printf
+                (
+                    "getOffset %d from %p yields %p\n",
+                    e->u.o.location, arg, result
+                );
+            }
+            break;
+
+        case getLocal:
+            result = currentContext->data[e->u.o.location];
+            if (TRACE && displayOperators)
+            {
+                printf
+                (
+                    "getLocal %d from %p yields %p\n",
+                    e->u.o.location, currentContext, result
+                );
+            }
+            break;
+
+        case getSelfField:
+            arg = currentContext->data[1];
+            undefCheck(9, arg, e->u.o.symbol);
+            result = arg->data[e->u.o.location];
+            if (TRACE && displayOperators)
+            {
+                printf
+                (
+                    "getSelfField %d from %p yields %p\n",
+                    e->u.o.location, arg, result
+                );
+            }
+            break;
+
+        case checkDefined:
+            result = evaluateExpression(e->u.o.base);
+            undefCheck(16, result, e->u.o.symbol);
+            break;
+
+        case getGlobalOffset:
+            if (TRACE && displayOperators)
+            {
+                printf("get global offset %d\n", e->u.o.location);
+            }
+            result = globalContext->data[e->u.o.location];
+            break;
+
+        case makeReference:
+            arg = evaluateExpression(e->u.o.base);
+            undefCheck(10, arg, e->u.a.symbol);
+            rootStack[rootTop++] = arg;
+            result = binaryValue(e->u.o.location);
+            arg = rootStack[--rootTop];
+            result->data[0] = arg;
+            break;
+
+        case assignment:
+            if (e->u.a.left->operator == makeReference)
+            {
+                if
+                (
+                    e->u.a.left->u.o.base->operator == getCurrentContext
+                )
+                {
+                    arg = currentContext;
+                }
+                else
+                {
+                    arg = evaluateExpression(e->u.a.left->u.o.base);
+                    undefCheck(11, arg,
+                    e->u.a.left->u.a.symbol);
+                }
+                rootStack[rootTop++] = arg;
+                result = evaluateExpression(e->u.a.right);
+                arg = rootStack[--rootTop];
+                arg->data[e->u.a.left->u.o.location] = result;
+            }
+            else
+            {
+                arg = evaluateExpression(e->u.a.left);
+                rootStack[rootTop++] = arg;
+                result = evaluateExpression(e->u.a.right);
+                arg = rootStack[--rootTop];
+                arg->data[0]->data[intValue(arg)] = result;
+            }
+            if (TRACE && displayOperators)
+            {
+                printf("assignment gets %p\n", result);
+            }
+            result = 0;
+            break;
+
+        case assignLocal:
+            result = evaluateExpression(e->u.a.right);
+            currentContext->data[e->u.a.left->u.o.location] = result;
+            if (TRACE && displayOperators)
+            {
+                printf("assignment to local gets %p\n", result);
+            }
+            result = 0;
+            break;
+
+        // self cannot be changed, so it is safe to find it after the value
+        case assignSelfField:
+            result = evaluateExpression(e->u.a.right);
+            arg = currentContext->data[1];
+            undefCheck(11, arg, e->u.a.symbol);
+            arg->data[e->u.a.left->u.o.location] = result;
+            if (TRACE && displayOperators)
+            {
+                printf("assignment to field gets %p\n", result);
+            }
+            result = 0;
+            break;
+
+
+        case makeMethodContext:
+            // get the context
+            arg = evaluateExpression(e->u.o.base);
+            rootStack[rootTop++] = arg;
+            result = gcalloc(3);
+            arg = rootStack[--rootTop];
+            undefCheck(12, arg, e->u.o.symbol);
+            undefCheck(13, arg->data[0], "method table");
+            if (TRACE && displayOperators)
+            {
+                printf
+                (
+                    "make method %d context %p code\n",
+                    e->u.o.location, arg
+                    //(arg->data[0])[e->u.o.location]
+                );
+                printf("method table %p\n", arg->data[0]);
+            }
+            result->data[1] = arg;
+            result->data[2] = (arg->data[0])->data[e->u.o.location];
+            break;
+
+        case makeClosure:
+            result = gcalloc(2);
+            if (e->u.l.context->operator == getCurrentContext)
+            {
+                arg = currentContext;
+            }
+            else
+            {
+                rootStack[rootTop++] = result;
+                arg = evaluateExpression(e->u.l.context);
+                result = rootStack[--rootTop];
+                undefCheck(14, arg, "<context>");
+            }
+            if (TRACE && displayOperators)
+            {
+                printf
+                (
+                    "make closure %p, context = %p code = %p\n",
+                    result, arg, e->u.l.code
+                );
+            }
+            result->data[1] = arg;
+            result->data[2] = (struct ledaValue*) e->u.l.code;
+            break;
+
+        case doFunctionCall:
+            {
+                struct ledaValue* code;
+                struct ledaValue* context;
+                struct ledaValue* newContext;
+
+                char* functionName = e->u.f.symbol;
+                if (TRACE && displayOperators)
+                {
+                    printf("beginning function call operator\n");
+                }
+
+                if (functionName == 0)
+                {
+                    functionName = " ? ";
+                }
+
+                if (e->u.f.fun->operator == makeClosure)
+                {
+                    if (e->u.f.fun->u.l.context->operator == getCurrentContext)
+                    {
+                        context = currentContext;
+                    }
+                    else
+                    {
+                        context = evaluateExpression(e->u.f.fun->u.l.context);
+                        undefCheck(15, context,"context");
+                    }
+                    code = (struct ledaValue*)e->u.f.fun->u.l.code;
+                }
+                else if (e->u.f.fun->operator == makeMethodContext)
+                {
+                    struct expressionRecord* receiver = e->u.f.fun->u.o.base;
+                    if (receiver->operator == getLocal)
+                    {
+                        context = currentContext->data[receiver->u.o.location];
+                    }
+                    else
+                    {
+                        context = evaluateExpression(receiver);
+                    }
+                    undefCheck(16, context,"context");
+                    undefCheck(17, context->data[0],"method table");
+                    code = (context->data[0])->data
+                    [e->u.f.fun->u.o.location];
+                }
+                else
+                {
+                    arg = evaluateExpression(e->u.f.fun);
+                    undefCheck(18, arg, e->u.f.symbol);
+                    context = arg->data[1];
+                    code = arg->data[2];
+                }
+
+                // create the activation record
+                struct ledaValue* frameMark = framePointer;
+
+                rootStack[rootTop++] = context;
+                newContext = newActivationRecord(code, e->u.f.nargs + 4);
+                context = rootStack[--rootTop];
+                if (TRACE && displayOperators)
+                {
+                    printf
+                    (
+                        "do function call (%p) fun context %p, "
+                        "new context %p args:\n",
+                        currentContext, context, newContext
+                    );
+                }
+                newContext->data[1] = context;
+                newContext->data[2] = currentContext;
+                for (int i = 4; i < e->u.f.nargs + 4; i++)
+                {
+                    // tricky gc insurance
+                    rootStack[rootTop++] = newContext;
+                    arg = evaluateExpression(e->u.f.args[i - 4]);
+                    newContext = rootStack[--rootTop];
+                    newContext->data[i] = arg;
+                    if (TRACE && displayOperators)
+                    {
+                        printf
+                        (
+                            "argument %d in %p is %p\n",
+                            i, newContext, newContext->data[i]
+                        );
+                    }
+                }
+                if (TRACE && displayFunctions)
+                {
+                    printf
+                    (
+                        "do function (%p) call %s(%p), now do call\n",
+                        currentContext, functionName, code
+                    );
+                }
+                currentContext = newContext;
+                struct expressionRecord* primitive =
+                    TRACE ? 0 : primitiveBody(code);
+                if (primitive)
+                {
+                    result = evaluateSpecial
+                    (
+                        primitive->u.c.index,
+                        primitive->u.c.nargs,
+                        primitive->u.c.args
+                    );
+                }
+                else
+                {
+                    result = evaluateStatement((struct statementRecord*) code);
+                }
+                currentContext = currentContext->data[2];
+                framePointer = frameMark;
+                if (TRACE && displayFunctions)
+                {
+                    printf("return from function %s(%p)\n",
+                    functionName, code);
+                }
+            }
+            break;
+
+        case evalThunk:
+            // get the context
+            arg = evaluateExpression(e->u.o.base);
+            undefCheck(19, arg, "thunk");
+            if (TRACE && displayOperators)
+            {
+                printf("evaluate thunk\n");
+            }
+
+            // then evaluate the statement
+            rootStack[rootTop++] = currentContext;
+            currentContext = arg->data[1];
+            result = evaluateStatement((struct statementRecord*) arg->data[2]);
+            currentContext = rootStack[--rootTop];
+            break;
+
+        case evalReference:
+            arg = evaluateExpression(e->u.o.base);
+            if (TRACE && displayOperators)
+            {
+                printf("evaluate reference\n");
+            }
+            result = arg->data[0]->data[intValue(arg)];
+            break;
+
+        case genIntegerConstant:
+            result = newIntegerConstant(e->u.i.value);
+            if (TRACE && displayOperators)
+            {
+                printf("make integer constant %d\n", e->u.i.value);
+            }
+            break;
+
+        case genStringConstant:
+            result = newStringConstant(e->u.s.value);
+            if (TRACE && displayOperators)
+            {
+                printf("make string constant %p %s\n", result, e->u.s.value);
+            }
+            break;
+
+        case genRealConstant:
+            result = newRealConstant(e->u.r.value);
+            if (TRACE && displayOperators)
+            {
+                printf("make real constant %g\n", e->u.r.value);
+            }
+            break;
+
+        case loadConstant:
+            result = e->u.v.value;
+            break;
+
+        case doSpecialCall:
+            if (TRACE && displayOperators)
+            {
+                printf("do special operator %d\n", e->u.c.index);
+            }
+            result = evaluateSpecial(e->u.c.index, e->u.c.nargs, e->u.c.args);
+            break;
+
+        case buildInstance:
+            arg = evaluateExpression(e->u.n.table);
+            rootStack[rootTop++] = arg;
+            result = gcalloc(e->u.n.size);
+            arg = rootStack[--rootTop];
+            undefCheck(20, arg, "build instance table");
+            result->data[0] = arg;
+            result->data[1] = globalContext;
+            if (TRACE && displayOperators)
+            {
+                printf
+                (
+                    "build an instance %p, size %d table %p\n",
+                    result, e->u.n.size, result->data[0]
+                );
+            }
+            {
+                int max = e->u.n.size;
+                for (int i = 2; i < e->u.n.nargs + 2; i++)
+                {
+                    // Tricky gc insurance
+                    if (i > max)
+                    {
+                        yyerror("filling instance too big\n");
+                    }
+                    rootStack[rootTop++] = result;
+                    arg = evaluateExpression(e->u.n.args[i - 2]);
+                    result = rootStack[--rootTop];
+                    result->data[i] = arg;
+                    if (TRACE && displayOperators)
+                    {
+                        printf
+                        (
+                            "in instance %p location %d is %p\n",
+                            result, i, result->data[i]
+                        );
+                    }
+                }
+            }
+            break;
+
+        case commaOp:
+            arg = evaluateExpression(e->u.a.left);
+            // toss away arg
+            result = evaluateExpression(e->u.a.right);
+            break;
+
+        case patternMatch:
+            {
+                struct ledaValue* b = evaluateExpression(e->u.p.base);
+                undefCheck(30, b, "pattern base");
+                rootStack[rootTop++] = b;
+                struct ledaValue* a = evaluateExpression(e->u.p.class);
+                undefCheck(30, a, "pattern class");
+                b = rootStack[--rootTop];
+                // get the class of the value
+                arg = b->data[0];
+                result = falseObject;
+                while (1)
+                {
+                    if (a == arg)
+                    {
+                        result = trueObject;
+                        for (int i = 0; i < e->u.p.nargs; i++)
+                        {
+                            rootStack[rootTop++] = a;
+                            rootStack[rootTop++] = b;
+                            arg = evaluateExpression(e->u.p.args[i]);
+                            b = rootStack[--rootTop];
+                            a = rootStack[--rootTop];
+                            arg->data[0]->data[intValue(arg)] =
+                                b->data[i + 2];
+                        }
+                        break;
+                    }
+                    if (arg == arg->data[4]) break;
+                    arg = arg->data[4];
+                }
+            }
+            break;
+
+        default:
+            printf("unimplemented expression type %d\n", e->operator);
+            exit(1);
+    }
+    return result;
+}
+
+
+// -----------------------------------------------------------------------------
+///  Evaluate statements
+// -----------------------------------------------------------------------------
+
+static struct ledaValue* evaluateStatement
+(
+    struct statementRecord* st
+)
+{
+    register struct statementRecord* s = st;
+
+    if (s == 0)
+    {
+        yyerror("internal run-time error: empty statement");
+    }
+
+    if (rootTop >= ROOTSTACKLIMIT)
+    {
+        yyerror("root stack overflow\n");
+    }
+
+    struct ledaValue* result;
+
+    // Store debugging information in case it is needed
+    while (s)
+    {
+        linenumber = s->lineNumber;
+        fileName = s->fileName;
+
+        // Then do the statement
+        switch(s->statementType)
+        {
+            default:
+                printf("statement type is %d", s->statementType);
+                yyerror("unimplemented statement type");
+
+            case functionEntryStatement:
+                // The caller has already made room for the locals
+                if (TRACE && displayOperators)
+                {
+                    printf
+                    (
+                        "Enter function %p size %d\n",
+                        currentContext, s->u.k.size
+                    );
+                }
+                s = s->next;
+                break;
+
+            case expressionStatement:
+                if (TRACE && displayStatements)
+                {
+                    printf
+                    (
+                        "File %s Line %d: expression statement\n",
+                        s->fileName, s->lineNumber
+                    );
+                }
+                result = evaluateExpression(s->u.r.e);
+                // result should be empty
+                if (result)
+                {
+                    yyerror
+                    (
+                        "internal run-time error: "
+                        "expression statement is non-empty"
+                    );
+                }
+                s = s->next;
+                break;
+
+            case returnStatement:
+                if (TRACE && displayOperators)
+                {
+                    printf
+                    (
+                        "File %s Line %d: (%p,%p) Starting return statement\n",
+                        s->fileName, s->lineNumber,
+                        currentContext, currentContext->data[2]
+                    );
+                }
+                if (s->u.r.e)
+                {
+                    result = evaluateExpression(s->u.r.e);
+                }
+                else
+                {
+                    result = 0;
+                }
+                if (TRACE && displayStatements)
+                {
+                    printf
+                    (
+                        "File %s Line %d: return statement, yields %p\n",
+                        s->fileName, s->lineNumber, result
+                    );
+                }
+                return result;
+
+            case tailCall:
+                {
+                    struct ledaValue* code;
+                    struct ledaValue* context;
+                    struct ledaValue* newContext;
+
+                    struct expressionRecord* e =  s->u.r.e;
+                    char* functionName = e->u.f.symbol;
+
+                    if (TRACE && displayOperators)
+                    {
+                        printf("beginning function call operator\n");
+                    }
+
+                    if (functionName == 0)
+                    {
+                        functionName = " ? ";
+                    }
+
+                    if (e->u.f.fun->operator == makeClosure)
+                    {
+                        if
+                        (
+                            e->u.f.fun->u.l.context->operator
+                         == getCurrentContext
+                        )
+                        {
+                            context = currentContext;
+                        }
+                        else
+                        {
+                            context = evaluateExpression
+                            (
+                                e->u.f.fun->u.l.context
+                            );
+                            undefCheck(15, context,"context");
+                        }
+                        code = (struct ledaValue*)e->u.f.fun->u.l.code;
+                    }
+                    else if (e->u.f.fun->operator == makeMethodContext)
+                    {
+                        struct expressionRecord* receiver =
+                            e->u.f.fun->u.o.base;
+                        if (receiver->operator == getLocal)
+                        {
+                            context =
+                                currentContext->data[receiver->u.o.location];
+                        }
+                        else
+                        {
+                            context = evaluateExpression(receiver);
+                        }
+                        undefCheck(16, context,"context");
+                        undefCheck(17, context->data[0],"method table");
+                        code =
+                            (context->data[0])->data[e->u.f.fun->u.o.location];
+                    }
+                    else
+                    {
+                        struct ledaValue* arg = evaluateExpression(e->u.f.fun);
+                        undefCheck(18, arg, e->u.f.symbol);
+                        context = arg->data[1];
+                        code = arg->data[2];
+                    }
+
+                    // create the activation record
+                    rootStack[rootTop++] = context;
+                    newContext = newActivationRecord(code, e->u.f.nargs + 4);
+                    context = rootStack[--rootTop];
+                    if (TRACE && displayOperators)
+                    {
+                        printf
+                        (
+                            "do tail call fun context %p, "
+                            "new context %p args:\n",
+                            context, newContext
+                        );
+                    }
+                    newContext->data[1] = context;
+                    newContext->data[2] = currentContext->data[2];
+                    for (int i = 4; i < e->u.f.nargs + 4; i++)
+                    {
+                        // tricky gc insurance
+                        rootStack[rootTop++] = newContext;
+                        struct ledaValue* arg =
+                            evaluateExpression(e->u.f.args[i - 4]);
+                        newContext = rootStack[--rootTop];
+                        newContext->data[i] = arg;
+                        if (TRACE && displayOperators)
+                        {
+                            printf
+                            (
+                                "argument %d in %p is %p\n",
+                                i, newContext, newContext->data[i]
+                            );
+                        }
+                    }
+                    if (TRACE && displayFunctions)
+                    {
+                        printf
+                        (
+                            "tail function call %s(%p), now do call\n",
+                            functionName, code
+                        );
+                    }
+
+                    // The finished record on the frame stack can be reused
+                    if (inFrameStack(currentContext))
+                    {
+                        if (inFrameStack(newContext))
+                        {
+                            int size = (newContext->size >> 2) + 1;
+                            memmove
+                            (
+                                currentContext,
+                                newContext,
+                                size * sizeof(struct ledaValue)
+                            );
+                            newContext = currentContext;
+                            framePointer = newContext + size;
+                        }
+                        else
+                        {
+                            framePointer = currentContext;
+                        }
+                    }
+
+                    currentContext = newContext;
+                    struct expressionRecord* primitive =
+                        TRACE ? 0 : primitiveBody(code);
+                    if (primitive)
+                    {
+                        return evaluateSpecial
+                        (
+                            primitive->u.c.index,
+                            primitive->u.c.nargs,
+                            primitive->u.c.args
+                        );
+                    }
+                    s = (struct statementRecord*) code;
+                }
+                break;
+
+            case conditionalStatement:
+                if (TRACE && displayStatements)
+                {
+                    printf
+                    (
+                        "File %s Line %d: conditional statement\n",
+                        s->fileName, s->lineNumber
+                    );
+                }
+                result = evaluateExpression(s->u.c.expr);
+                if (result == trueObject)
+                {
+                    s = s->next;
+                }
+                else
+                {
+                    s = s->u.c.falsePart;
+                }
+                break;
+
+            case countedLoopStatement:
+                if (TRACE && displayStatements)
+                {
+                    printf
+                    (
+                        "File %s Line %d: counted loop test\n",
+                        s->fileName, s->lineNumber
+                    );
+                }
+                {
+                    // Reading the counter and limit cannot collect
+                    struct ledaValue* counter =
+                        evaluateExpression(s->u.l.counter);
+                    struct ledaValue* limit =
+                        evaluateExpression(s->u.l.limit);
+                    if
+                    (
+                        !TRACE
+                     && counter && (counter->data[0] == integerClass)
+                     && limit && (limit->data[0] == integerClass)
+                    )
+                    {
+                        result = (intValue(counter) <= intValue(limit))
+                            ? trueObject : falseObject;
+                    }
+                    else
+                    {
+                        result = evaluateExpression(s->u.l.expr);
+                    }
+                }
+                if (result == trueObject)
+                {
+                    s = s->next;
+                }
+                else
+                {
+                    s = s->u.l.falsePart;
+                }
+                break;
+
+            case nullStatement:
+                s = s->next;
+                break;
+        };
+    };
+
+    return 0;
+}
+
+
+// -----------------------------------------------------------------------------
@@ -13,7 +13,7 @@
 
 #include "lc.h"
 #include "interp.h"
-#include <malloc.h>
+#include "memory.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -32,14 +32,7 @@ static struct expressionRecord* genOffset
 
 struct statementRecord* newStatement(enum statements st)
 {
-    struct statementRecord* s =
-        (struct statementRecord*) malloc(sizeof(struct statementRecord));
-
-    if (s == 0)
-    {
-        yyerror("out of memory");
-    }
-
+    struct statementRecord* s = compilerNew(struct statementRecord);
     s->fileName = fileName;
     s->lineNumber = linenumber;
     s->statementType = st;
@@ -98,7 +91,7 @@ static int canMakeIntoTailCall
     }
 
     // There must be only one argument
-    if (length(e->u.f.args) != 1)
+    if (e->u.f.nargs != 1)
     {
         return 0;
     }
@@ -110,7 +103,7 @@ static int canMakeIntoTailCall
     }
 
     // The one argument must be the same as current argument
-    e = (struct expressionRecord*) e->u.f.args->value;
+    e = e->u.f.args[0];
     if (e->operator != getOffset)
     {
         return 0;
@@ -239,6 +232,361 @@ struct statementRecord* genWhileStatement
     return s;
 }
 
+// -----------------------------------------------------------------------------
+/// Escape analysis
+// -----------------------------------------------------------------------------
+//- A function context escapes if it is used for anything other than
+//  reading or writing its own slots.
+//  Closures, thunks, references and calls to nested functions all
+//  capture the context; contexts that do not escape are allocated
+//  on the frame stack.
+
+static int contextEscapes(struct expressionRecord* e);
+
+static int argumentsEscape(int n, struct expressionRecord** args)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (contextEscapes(args[i]))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int contextEscapes(struct expressionRecord* e)
+{
+    if (e == 0)
+    {
+        return 0;
+    }
+
+    switch(e->operator)
+    {
+        case getCurrentContext:
+            return 1;
+
+        case getOffset:
+            if (e->u.o.base->operator == getCurrentContext)
+            {
+                return 0;
+            }
+            return contextEscapes(e->u.o.base);
+
+        case evalThunk:
+        case evalReference:
+        case makeMethodContext:
+        case makeReference:
+        case checkDefined:
+            return contextEscapes(e->u.o.base);
+
+        case getGlobalOffset:
+        case genIntegerConstant:
+        case genStringConstant:
+        case genRealConstant:
+        case loadConstant:
+        case getLocal:
+        case getSelfField:
+            return 0;
+
+        case assignLocal:
+        case assignSelfField:
+            return contextEscapes(e->u.a.right);
+
+        case assignment:
+            if
+            (
+                (e->u.a.left->operator == makeReference)
+             && (e->u.a.left->u.o.base->operator == getCurrentContext)
+            )
+            {
+                return contextEscapes(e->u.a.right);
+            }
+            return contextEscapes(e->u.a.left) || contextEscapes(e->u.a.right);
+
+        case commaOp:
+            return contextEscapes(e->u.a.left) || contextEscapes(e->u.a.right);
+
+        case makeClosure:
+            return contextEscapes(e->u.l.context);
+
+        case doFunctionCall:
+            return
+                contextEscapes(e->u.f.fun)
+             || argumentsEscape(e->u.f.nargs, e->u.f.args);
+
+        case doSpecialCall:
+            return argumentsEscape(e->u.c.nargs, e->u.c.args);
+
+        case buildInstance:
+            return
+                contextEscapes(e->u.n.table)
+             || argumentsEscape(e->u.n.nargs, e->u.n.args);
+
+        case patternMatch:
+            // The references are only used while the match is performed
+            if (contextEscapes(e->u.p.base) || contextEscapes(e->u.p.class))
+            {
+                return 1;
+            }
+            for (int i = 0; i < e->u.p.nargs; i++)
+            {
+                struct expressionRecord* r = e->u.p.args[i];
+                if
+                (
+                    (r->u.o.base->operator != getCurrentContext)
+                 && contextEscapes(r)
+                )
+                {
+                    return 1;
+                }
+            }
+            return 0;
+    }
+
+    return 1;
+}
+
+
+//- Statements form a graph (loops point back), so remember what has been seen
+static int bodyEscapes(struct statementRecord* s, struct list** seen)
+{
+    while (s)
+    {
+        for (struct list* p = *seen; p; p = p->next)
+        {
+            if ((struct statementRecord*) p->value == s)
+            {
+                return 0;
+            }
+        }
+        *seen = newList((char*) s, *seen);
+
+        switch(s->statementType)
+        {
+            case expressionStatement:
+            case returnStatement:
+            case tailCall:
+                if (contextEscapes(s->u.r.e))
+                {
+                    return 1;
+                }
+                break;
+
+            case conditionalStatement:
+                if (contextEscapes(s->u.c.expr))
+                {
+                    return 1;
+                }
+                if (bodyEscapes(s->u.c.falsePart, seen))
+                {
+                    return 1;
+                }
+                break;
+
+            case countedLoopStatement:
+                if
+                (
+                    contextEscapes(s->u.l.expr)
+                 || contextEscapes(s->u.l.counter)
+                 || contextEscapes(s->u.l.limit)
+                 || bodyEscapes(s->u.l.falsePart, seen)
+                )
+                {
+                    return 1;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        s = s->next;
+    }
+
+    return 0;
+}
+
+
+// -----------------------------------------------------------------------------
+/// Instruction selection
+// -----------------------------------------------------------------------------
+//- Once a body is complete, the most common access patterns are
+//  replaced by fused instructions.  This cannot be done as the code is
+//  generated, since the generator inspects getOffset and assignment
+//  expressions it has already built.  Each rewrite depends only upon
+//  the shape of the expression, so shared nodes can be visited twice.
+
+static void fuseStatements(struct statementRecord* s, struct list** seen);
+
+// Calls considered by inlinePrimitives once the program is complete
+static struct list* inlineCalls = 0;
+static struct list* inlineTailCalls = 0;
+
+struct list* foldCandidates = 0;
+
+static int isSelf(struct expressionRecord* e)
+{
+    return (e->operator == getLocal) && (e->u.o.location == 1);
+}
+
+
+static int isLiteral(struct expressionRecord* e)
+{
+    return
+        (e->operator == genIntegerConstant)
+     || (e->operator == genStringConstant)
+     || (e->operator == genRealConstant);
+}
+
+
+static void fuseExpression(struct expressionRecord* e, struct list** seen)
+{
+    if (e == 0)
+    {
+        return;
+    }
+
+    switch(e->operator)
+    {
+        case getOffset:
+            fuseExpression(e->u.o.base, seen);
+            if (e->u.o.base->operator == getCurrentContext)
+            {
+                e->operator = getLocal;
+            }
+            else if (isSelf(e->u.o.base))
+            {
+                e->operator = getSelfField;
+            }
+            break;
+
+        case evalThunk:
+        case evalReference:
+        case makeMethodContext:
+        case makeReference:
+            fuseExpression(e->u.o.base, seen);
+            break;
+
+        case assignment:
+            fuseExpression(e->u.a.left, seen);
+            fuseExpression(e->u.a.right, seen);
+            if (e->u.a.left->operator == makeReference)
+            {
+                if (e->u.a.left->u.o.base->operator == getCurrentContext)
+                {
+                    e->operator = assignLocal;
+                }
+                else if (isSelf(e->u.a.left->u.o.base))
+                {
+                    e->operator = assignSelfField;
+                }
+            }
+            break;
+
+        case commaOp:
+            fuseExpression(e->u.a.left, seen);
+            fuseExpression(e->u.a.right, seen);
+            break;
+
+        case makeClosure:
+            fuseExpression(e->u.l.context, seen);
+            // Function bodies are done by genBody, thunks are done here
+            if (e->u.l.code->statementType != functionEntryStatement)
+            {
+                fuseStatements(e->u.l.code, seen);
+            }
+            break;
+
+        case doFunctionCall:
+            fuseExpression(e->u.f.fun, seen);
+            for (int i = 0; i < e->u.f.nargs; i++)
+            {
+                fuseExpression(e->u.f.args[i], seen);
+            }
+            inlineCalls = newList((char*) e, inlineCalls);
+            break;
+
+        case doSpecialCall:
+            for (int i = 0; i < e->u.c.nargs; i++)
+            {
+                fuseExpression(e->u.c.args[i], seen);
+            }
+            foldCandidates = newList((char*) e, foldCandidates);
+            break;
+
+        case buildInstance:
+            fuseExpression(e->u.n.table, seen);
+            for (int i = 0; i < e->u.n.nargs; i++)
+            {
+                fuseExpression(e->u.n.args[i], seen);
+            }
+            break;
+
+        case patternMatch:
+            fuseExpression(e->u.p.base, seen);
+            fuseExpression(e->u.p.class, seen);
+            for (int i = 0; i < e->u.p.nargs; i++)
+            {
+                fuseExpression(e->u.p.args[i], seen);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+static void fuseStatements(struct statementRecord* s, struct list** seen)
+{
+    while (s)
+    {
+        for (struct list* p = *seen; p; p = p->next)
+        {
+            if ((struct statementRecord*) p->value == s)
+            {
+                return;
+            }
+        }
+        *seen = newList((char*) s, *seen);
+
+        switch(s->statementType)
+        {
+            case tailCall:
+                inlineTailCalls = newList((char*) s, inlineTailCalls);
+                fuseExpression(s->u.r.e, seen);
+                break;
+
+            case expressionStatement:
+            case returnStatement:
+                fuseExpression(s->u.r.e, seen);
+                break;
+
+            case conditionalStatement:
+                fuseExpression(s->u.c.expr, seen);
+                fuseStatements(s->u.c.falsePart, seen);
+                break;
+
+            case countedLoopStatement:
+                fuseExpression(s->u.l.expr, seen);
+                fuseExpression(s->u.l.counter, seen);
+                fuseExpression(s->u.l.limit, seen);
+                fuseStatements(s->u.l.falsePart, seen);
+                break;
+
+            default:
+                break;
+        }
+
+        s = s->next;
+    }
+}
+
+
 struct statementRecord* genBody
 (
     struct symbolTableRecord* syms,
@@ -247,16 +595,13 @@ struct statementRecord* genBody
 {
     // Make base for constants
     struct expressionRecord* base = newExpression(getCurrentContext);
-    if (syms->ttype == functionTable)
-    {
-        base = genOffset(base, 3, 0, 0);
-    }
 
-    // Make all the constants into assignment statements
+    // Make all the constants into assignment statements,
+    // literal constants are used in place (see genFromSymbol)
     for (struct list* p = syms->firstSymbol; p; p = p->next)
     {
         struct symbolRecord* sym = (struct symbolRecord*) p->value;
-        if (sym->styp == constSymbol)
+        if ((sym->styp == constSymbol) && !isLiteral(sym->u.s.val))
         {
             struct statementRecord* st = genAssignmentStatement
             (
@@ -271,15 +616,241 @@ struct statementRecord* genBody
         }
     }
 
-    // Then make the local statement
-    struct statementRecord* s = newStatement(makeLocalsStatement);
+    // Then make the entry statement describing the activation record
+    struct statementRecord* s = newStatement(functionEntryStatement);
     s->u.k.size = syms->size;
+    s->u.k.escapes = 1;
     s->next = code;
 
+    if (syms->ttype == functionTable)
+    {
+        struct list* seen = 0;
+        s->u.k.size += syms->u.f.argumentLocation;
+        s->u.k.escapes = bodyEscapes(code, &seen);
+    }
+
+    struct list* seen = 0;
+    fuseStatements(code, &seen);
+
+    // Methods such as integer plus are wrappers for a single cfunction
+    s->u.k.primitive =
+        (syms->ttype == functionTable)
+     && code
+     && (code->statementType == returnStatement)
+     && code->u.r.e
+     && (code->u.r.e->operator == doSpecialCall);
+
     return s;
 }
 
 
+// -----------------------------------------------------------------------------
+/// Inlining of primitive methods
+// -----------------------------------------------------------------------------
+//- A call to a primitive method (one whose body only returns the result
+//  of a cfunction, see genBody) can be replaced by the cfunction call
+//  itself, when the method cannot be overridden and its arguments are
+//  passed to the cfunction unchanged and in order.
+//  Whether a method is overridden is known only once every class has
+//  been seen, and function bodies are filled in after their first use,
+//  so this is done for the whole program before it is run.
+
+//- The class through whose method table a value of type t is dispatched
+static struct typeRecord* receiverClass(struct typeRecord* t)
+{
+    while (t)
+    {
+        switch(t->ttyp)
+        {
+            case classType:
+                return t;
+
+            case qualifiedType:
+                t = t->u.q.baseType;
+                break;
+
+            case resolvedType:
+                t = t->u.r.baseType;
+                break;
+
+            case constantType:
+            case unresolvedType:
+                t = t->u.u.baseType;
+                break;
+
+            default:
+                return 0;
+        }
+    }
+
+    return 0;
+}
+
+
+//- True if some class inheriting from c has its own method at location
+static int methodOverridden
+(
+    struct symbolTableRecord* globals,
+    struct typeRecord* c,
+    int location
+)
+{
+    struct ledaValue* code = c->u.c.staticTable->data[location];
+
+    for (struct list* p = globals->firstSymbol; p; p = p->next)
+    {
+        struct symbolRecord* s = (struct symbolRecord*) p->value;
+        if (s->styp != classDefSymbol)
+        {
+            continue;
+        }
+
+        struct typeRecord* d = checkClass(s->u.c.typ);
+        if ((d == 0) || (d->u.c.staticTable == 0))
+        {
+            continue;
+        }
+
+        for (struct typeRecord* t = d; t; )
+        {
+            if (t == c)
+            {
+                if (d->u.c.staticTable->data[location] != code)
+                {
+                    return 1;
+                }
+                break;
+            }
+
+            struct typeRecord* parent =
+                t->u.c.parent ? checkClass(t->u.c.parent) : 0;
+            t = (parent == t) ? 0 : parent;
+        }
+    }
+
+    return 0;
+}
+
+
+//- The cfunction call of a primitive function or method, if it is
+//  given self (for a method) and then the arguments in order
+static struct expressionRecord* primitiveCall
+(
+    struct statementRecord* code,
+    int isMethod,
+    int nargs
+)
+{
+    if
+    (
+        (code == 0)
+     || (code->statementType != functionEntryStatement)
+     || !code->u.k.primitive
+    )
+    {
+        return 0;
+    }
+
+    struct expressionRecord* special = code->next->u.r.e;
+    if (special->u.c.nargs != nargs + isMethod)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < special->u.c.nargs; i++)
+    {
+        // self is location 1, the arguments start at location 4
+        int location = (i < isMethod) ? 1 : 4 + i - isMethod;
+        struct expressionRecord* a = special->u.c.args[i];
+        if ((a->operator != getLocal) || (a->u.o.location != location))
+        {
+            return 0;
+        }
+    }
+
+    return special;
+}
+
+
+void inlinePrimitives(struct symbolTableRecord* globals)
+{
+    for (struct list* p = inlineCalls; p; p = p->next)
+    {
+        struct expressionRecord* e = (struct expressionRecord*) p->value;
+        if (e->operator != doFunctionCall)
+        {
+            continue;   // already inlined
+        }
+
+        struct expressionRecord* fun = e->u.f.fun;
+        struct expressionRecord* receiver = 0;
+        struct statementRecord* code = 0;
+
+        if (fun->operator == makeMethodContext)
+        {
+            struct typeRecord* c = receiverClass(fun->u.o.base->resultType);
+            int location = fun->u.o.location;
+            if
+            (
+                (c == 0)
+             || (c->u.c.staticTable == 0)
+             || (location >= (c->u.c.staticTable->size >> 2))
+             || methodOverridden(globals, c, location)
+            )
+            {
+                continue;
+            }
+            code = (struct statementRecord*)
+                c->u.c.staticTable->data[location];
+            receiver = fun->u.o.base;
+        }
+        else if (fun->operator == makeClosure)
+        {
+            code = fun->u.l.code;
+        }
+
+        int isMethod = (receiver != 0);
+        struct expressionRecord* special =
+            primitiveCall(code, isMethod, e->u.f.nargs);
+        if (special == 0)
+        {
+            continue;
+        }
+
+        // The receiver is still checked, as the method call did
+        int nargs = special->u.c.nargs;
+        struct expressionRecord** args = (struct expressionRecord**)
+            compilerAllocate(nargs * sizeof(struct expressionRecord*));
+        if (isMethod)
+        {
+            args[0] = newExpression(checkDefined);
+            args[0]->u.o.base = receiver;
+            args[0]->u.o.symbol = "context";
+        }
+        for (int i = 0; i < e->u.f.nargs; i++)
+        {
+            args[i + isMethod] = e->u.f.args[i];
+        }
+
+        e->operator = doSpecialCall;
+        e->u.c.index = special->u.c.index;
+        e->u.c.nargs = nargs;
+        e->u.c.args = args;
+        foldCandidates = newList((char*) e, foldCandidates);
+    }
+
+    // A tail call that has been inlined is now an ordinary return
+    for (struct list* p = inlineTailCalls; p; p = p->next)
+    {
+        struct statementRecord* s = (struct statementRecord*) p->value;
+        if (s->u.r.e->operator != doFunctionCall)
+        {
+            s->statementType = returnStatement;
+        }
+    }
+}
+
+
 // -----------------------------------------------------------------------------
 /// Expressions
 // -----------------------------------------------------------------------------
@@ -293,12 +864,9 @@ struct expressionRecord* newExpression(enum instructions opcode)
         return getCC;
     }
 
-    struct expressionRecord* e =
-        (struct expressionRecord*)malloc(sizeof(struct expressionRecord));
-    if (e == 0)
-    {
-        yyerror("out of memory\n");
-    }
+    // Fields a form does not set are left null, as program images
+    // rely upon
+    struct expressionRecord* e = compilerNew(struct expressionRecord);
     e->operator = opcode;
     e->resultType = 0;
     if (opcode == getCurrentContext)
@@ -310,11 +878,33 @@ struct expressionRecord* newExpression(enum instructions opcode)
 }
 
 
+//- Argument lists are turned into arrays once, so calls need not walk them
+struct expressionRecord** argumentArray(struct list* args, int* n)
+{
+    *n = length(args);
+    if (*n == 0)
+    {
+        return 0;
+    }
+
+    struct expressionRecord** a = (struct expressionRecord**)
+        compilerAllocate(*n * sizeof(struct expressionRecord*));
+
+    for (int i = 0; args; i++, args = args->next)
+    {
+        a[i] = (struct expressionRecord*) args->value;
+    }
+
+    return a;
+}
+
+
 struct expressionRecord* integerConstant(int v)
 {
     struct expressionRecord* e = newExpression(genIntegerConstant);
     e->u.i.value = v;
     e->resultType = integerType;
+    foldCandidates = newList((char*) e, foldCandidates);
 
     return e;
 }
@@ -325,6 +915,7 @@ struct expressionRecord* stringConstant(char* s)
     struct expressionRecord* e = newExpression(genStringConstant);
     e->u.s.value = s;
     e->resultType = stringType;
+    foldCandidates = newList((char*) e, foldCandidates);
 
     return e;
 }
@@ -335,6 +926,7 @@ struct expressionRecord* realConstant(double v)
     struct expressionRecord* e = newExpression(genRealConstant);
     e->u.r.value = v;
     e->resultType = realType;
+    foldCandidates = newList((char*) e, foldCandidates);
 
     return e;
 }
@@ -368,7 +960,6 @@ static struct expressionRecord* genFromSymbol
 (
     struct expressionRecord* base,
     struct symbolRecord* s,
-    int isFunctionTable,
     int isGlobals
 )
 {
@@ -377,19 +968,11 @@ static struct expressionRecord* genFromSymbol
     switch(s->styp)
     {
         case varSymbol:
-            if (isFunctionTable)
+            e = genOffset(base,
+            s->u.v.location, s, s->u.v.typ);
+            if (isGlobals)
             {
-                e = genOffset(genOffset(base, 3, 0, 0),
-                s->u.v.location, s, s->u.v.typ);
-            }
-            else
-            {
-                e = genOffset(base,
-                s->u.v.location, s, s->u.v.typ);
-                if (isGlobals)
-                {
-                    e->operator = getGlobalOffset;
-                }
+                e->operator = getGlobalOffset;
             }
             break;
 
@@ -447,23 +1030,20 @@ static struct expressionRecord* genFromSymbol
             break;
 
         case constSymbol:
-            if (isFunctionTable)
-            {
-                e = genOffset
-                (
-                    genOffset(base, 3, 0, 0),
-                    s->u.s.location,
-                    s,
-                    s->u.s.typ
-                );
-            }
-            else
+            if (isLiteral(s->u.s.val))
             {
-                e = genOffset(base,
-                s->u.s.location, s, s->u.s.typ);
-                //if (isGlobals)
-                //  e->operator = getGlobalOffset;
+                // A copy of the literal, typed as a constant so it
+                // still cannot be assigned
+                e = newExpression(s->u.s.val->operator);
+                e->u = s->u.s.val->u;
+                e->resultType = s->u.s.typ;
+                foldCandidates = newList((char*) e, foldCandidates);
+                break;
             }
+            e = genOffset(base,
+            s->u.s.location, s, s->u.s.typ);
+            //if (isGlobals)
+            //  e->operator = getGlobalOffset;
             break;
 
         default:
@@ -490,7 +1070,6 @@ static struct expressionRecord* generateTemporary
     (
         newExpression(getCurrentContext),
         addVariable(syms, newString(name), t),
-        1,
         0
     );
 }
@@ -567,7 +1146,7 @@ static struct expressionRecord* makeMethodIntoFunction
                     q = q->next;
                 }
             }
-            f->u.f.args = args;
+            f->u.f.args = argumentArray(args, &f->u.f.nargs);
             struct statementRecord* st = newStatement(returnStatement);
             st->u.r.e = f;
             e = newExpression(makeClosure);
@@ -647,7 +1226,7 @@ struct expressionRecord* lookupField
             struct symbolRecord* s = (struct symbolRecord*) p->value;
             if (strcmp(fieldName, s->name) == 0)
             {
-                return genFromSymbol(base, s, 0, 0);
+                return genFromSymbol(base, s, 0);
             }
         }
 
@@ -669,7 +1248,7 @@ struct expressionRecord* lookupField
                 }
                 else
                 {
-                    struct expressionRecord* e = genFromSymbol(base, s, 0, 0);
+                    struct expressionRecord* e = genFromSymbol(base, s, 0);
                     return e;
                 }
             }
@@ -704,12 +1283,12 @@ static struct expressionRecord* lookupAddress
     switch(syms->ttype)
     {
         case globals:   // See if it is in the global symbol table
-            for (struct list* p = syms->firstSymbol; p; p = p->next)
+            for (struct list* p = symbolsNamed(syms, name); p; p = p->next)
             {
                 struct symbolRecord* s = (struct symbolRecord*) p->value;
                 if (strcmp(name, s->name) == 0)
                 {
-                    return genFromSymbol(base, s, 0, 1);
+                    return genFromSymbol(base, s, 1);
                 }
             }
             return 0;   // Not known
@@ -720,7 +1299,7 @@ static struct expressionRecord* lookupAddress
                 struct symbolRecord* s = (struct symbolRecord*) p->value;
                 if (strcmp(name, s->name) == 0)
                 {
-                    return genFromSymbol(base, s, 1, 0);
+                    return genFromSymbol(base, s, 0);
                 }
             }
             // Not local, try next level
@@ -850,7 +1429,7 @@ struct expressionRecord* generateFunctionCall
             e->u.n.table = base;
             e->u.n.size = ft->u.q.baseType->
             u.q.baseType->u.c.symbols->size;
-            e->u.n.args = reverse(args);
+            e->u.n.args = argumentArray(reverse(args), &e->u.n.nargs);
             e->resultType = fixResolvedType(ft->u.q.baseType, t);
             if (isFun == 0)
             {
@@ -868,7 +1447,7 @@ struct expressionRecord* generateFunctionCall
         struct expressionRecord* e = newExpression(buildInstance);
         e->u.n.table = base;
         e->u.n.size = t->u.q.baseType->u.c.symbols->size;
-        e->u.n.args = reverse(args);
+        e->u.n.args = argumentArray(reverse(args), &e->u.n.nargs);
         e->resultType = t->u.q.baseType;
         if (isFun == 0)
         {
@@ -940,7 +1519,7 @@ struct expressionRecord* generateFunctionCall
     // Finally, make the function call expression
     struct expressionRecord* e = newExpression(doFunctionCall);
     e->u.f.fun = base;
-    e->u.f.args = args;
+    e->u.f.args = argumentArray(args, &e->u.f.nargs);
     if (base->operator == getOffset)
     {
         e->u.f.symbol = base->u.o.symbol;
@@ -1011,7 +1590,7 @@ struct expressionRecord* generateCFunctionCall
 
     // Reverse args, so that they are in order
     // Makes use of cfunction for allocation easier
-    e->u.c.args = reverse(args);
+    e->u.c.args = argumentArray(reverse(args), &e->u.c.nargs);
     e->resultType = rt;
 
     return e;
@@ -1031,7 +1610,7 @@ static struct expressionRecord* checkBinarySymbol
         return 0;
     }
 
-    struct expressionRecord* e = genFromSymbol(base, s, 0, 0);
+    struct expressionRecord* e = genFromSymbol(base, s, 0);
 
     if (argumentsCanMatch(e->resultType, args))
     {
@@ -1053,7 +1632,7 @@ static struct expressionRecord* lookupBinaryOperator
     switch(syms->ttype)
     {
         case globals:
-            for (struct list* p = syms->firstSymbol; p; p = p->next)
+            for (struct list* p = symbolsNamed(syms, name); p; p = p->next)
             {
                 struct expressionRecord* e = checkBinarySymbol
                 (
@@ -1275,7 +1854,11 @@ struct expressionRecord* generateLeftArrow
 
     struct expressionRecord* e = newExpression(doFunctionCall);
     e->u.f.fun = lookupFunction(syms, newString("Leda_arrow"));
-    e->u.f.args = newList((char*) right, newList((char*) r, 0));
+    e->u.f.args = argumentArray
+    (
+        newList((char*) right, newList((char*) r, 0)),
+        &e->u.f.nargs
+    );
     e->resultType = relationType;
 
     return e;
@@ -1315,7 +1898,11 @@ struct expressionRecord* generateForRelation
     // Now make function call
     struct expressionRecord* e = newExpression(doFunctionCall);
     e->u.f.fun = lookupFunction(syms, newString("Leda_forRelation"));
-    e->u.f.args = newList((char*) s, newList((char*) relExp, 0));
+    e->u.f.args = argumentArray
+    (
+        newList((char*) s, newList((char*) relExp, 0)),
+        &e->u.f.nargs
+    );
     e->resultType = 0;
 
     return e;
@@ -1333,7 +1920,7 @@ struct expressionRecord* booleanCheck
     {
         struct expressionRecord* f = newExpression(doFunctionCall);
         f->u.f.fun = lookupFunction(syms, newString("relationAsBoolean"));
-        f->u.f.args = newList((char*) e, 0);
+        f->u.f.args = argumentArray(newList((char*) e, 0), &f->u.f.nargs);
         f->resultType = booleanType;
         e = f;
     }
@@ -1353,7 +1940,8 @@ struct expressionRecord* relationCheck
     {
         struct expressionRecord* f = newExpression(doFunctionCall);
         f->u.f.fun = lookupFunction(syms, newString("booleanAsRelation"));
-        f->u.f.args = newList((char*) genThunk(e), 0);
+        f->u.f.args =
+            argumentArray(newList((char*) genThunk(e), 0), &f->u.f.nargs);
         f->resultType = relationType;
         e = f;
     }
@@ -1412,7 +2000,24 @@ struct statementRecord* generateArithmeticForStatement
     // Now put all the pieces together
     s->next = s2;
     stLast->next = is;
-    s2->next = genWhileStatement(ln, test, stFirst, is, nullState);
+    // (assigning the target has made a global offset into an offset)
+    if (target->operator != getOffset)
+    {
+        s2->next = genWhileStatement(ln, test, stFirst, is, nullState);
+        return s;
+    }
+
+    // The loop test compares integer counters directly,
+    // other values are tested by calling lessEqual
+    struct statementRecord* loop = newStatement(countedLoopStatement);
+    loop->lineNumber = ln;
+    loop->u.l.expr = test;
+    loop->u.l.falsePart = nullState;
+    loop->u.l.counter = target;
+    loop->u.l.limit = temp;
+    loop->next = stFirst;
+    is->next = loop;
+    s2->next = loop;
 
     return s;
 }
@@ -1469,16 +2074,23 @@ struct expressionRecord* generateArrayLiteral
     // Make the expression that represents the arguments
     struct expressionRecord* arge = newExpression(doSpecialCall);
     arge->u.c.index = 15;
-    arge->u.c.args = newList((char*) integerConstant(length(exps)),
-    reverse(exps));
+    arge->u.c.args = argumentArray
+    (
+        newList((char*) integerConstant(length(exps)), reverse(exps)),
+        &arge->u.c.nargs
+    );
 
     // Now build the array
     struct expressionRecord* e = newExpression(buildInstance);
     e->u.n.table = ae;
     e->u.n.size = 4;  // length(exps);
-    e->u.n.args = newList((char*) integerConstant(1),
-    newList((char*) integerConstant(length(exps)),
-    newList((char*) arge, 0)));
+    e->u.n.args = argumentArray
+    (
+        newList((char*) integerConstant(1),
+        newList((char*) integerConstant(length(exps)),
+        newList((char*) arge, 0))),
+        &e->u.n.nargs
+    );
     e->resultType = fixResolvedType(rt->u.r.baseType->u.q.baseType, rt);
 
     return e;
@@ -1517,7 +2129,7 @@ struct expressionRecord* genPatternMatch
         p = newList((char*) ne, p);
     }
 
-    e->u.p.args = p;
+    e->u.p.args = argumentArray(p, &e->u.p.nargs);
     e->resultType = booleanType;
 
     return e;
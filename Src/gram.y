@@ -191,7 +191,8 @@ typelist:
 functiondeclaration:
     functionHead declarations body SEMI
         {
-            (syms->u.f.theFunctionSymbol)->u.f.code->next = genBody(syms, $3);
+            // Fill in the placeholder, which may already be referenced
+            *(syms->u.f.theFunctionSymbol)->u.f.code = *genBody(syms, $3);
             syms = syms->surroundingContext;
         }
     ;
@@ -594,7 +595,8 @@ functionCall:
         {
             $$ = newExpression(doSpecialCall);
             $$->u.c.index = 22;
-            $$->u.c.args = newList((char*) $3, 0);
+            $$->u.c.args =
+                argumentArray(newList((char*) $3, 0), &$$->u.c.nargs);
             $$->resultType = booleanType;
         }
     | functionCall LEFTPAREN optexpressionList RIGHTPAREN
@@ -675,38 +677,53 @@ int yyerror(char* s)
     exit(1);
 }
 
-static char* includeDirectories[10];
-static int includeDirTop = 0;
+// Directories searched for include files, in the order given
+static struct list* includeDirectories = 0;
 
+// Canonical names of the files included so far, each is read only once
+static struct list* includedFiles = 0;
+
+//- Returns true if name is an existing file, which is opened
+//  unless it has been included before.
+//  name becomes the file name of the statements read from it
 static int testInclude(char* name)
 {
-    FILE * fid;
-    fid = fopen(name, "r");
+    char* path = realpath(name, NULL);
+    if (path == NULL)
+    {
+        return 0;
+    }
 
-    if (fid != NULL)
+    for (struct list* p = includedFiles; p; p = p->next)
     {
-        fclose(fid);
-        openInputFile(name);
-        return 1;
+        if (strcmp(p->value, path) == 0)
+        {
+            free(path);
+            return 1;
+        }
     }
 
-    fclose(fid);
+    includedFiles = newList(path, includedFiles);
+    openInputFile(name);
 
-    return 0;
+    return 1;
 }
 
 void doInclude(char* name)
 {
-    int i;
-    char namebuffer[256];
-
     if (testInclude(name)) return;
-    for (i = 0; i < includeDirTop; i++)
+
+    for (struct list* p = includeDirectories; p; p = p->next)
     {
-        strcpy(namebuffer, includeDirectories[i]);
-        strcat(namebuffer, "/");
-        strcat(namebuffer, name);
+        char* namebuffer =
+            (char*) malloc(strlen(p->value) + strlen(name) + 2);
+        if (namebuffer == 0)
+        {
+            yyerror("out of memory");
+        }
+        sprintf(namebuffer, "%s/%s", p->value, name);
         if (testInclude(namebuffer)) return;
+        free(namebuffer);
     }
 
     yyserror("unable to open include file %s", name);
@@ -720,7 +737,13 @@ int main(int argc, char** argv)
 
     // Default values for memory management
     int initialMemorySize = 200000;
-    int initialStaticMemorySize =  800;
+    int initialStaticMemorySize = 4000;
+    int initialFrameStackSize = 100000;
+
+    // Switches may appear on either side of the file name, so they are all
+    // read before anything is run
+    char* inputFileName = 0;
+    char* imageName = 0;
 
     for (int i = 1; i < argc; i++)
     {
@@ -748,15 +771,23 @@ int main(int argc, char** argv)
         {
             justParse = 1;
         }
+        else if (strcmp(argv[i], "-save-image") == 0)
+        {
+            imageFileName = argv[++i];
+        }
+        else if (strcmp(argv[i], "-image") == 0)
+        {
+            imageName = argv[++i];
+        }
         else if ((argv[i][0] == '-') && (argv[i][1] == 'I'))
         {
             if (argv[i][2])
             {
-                includeDirectories[includeDirTop++] = &argv[i][2];
+                includeDirectories = newList(&argv[i][2], includeDirectories);
             }
             else
             {
-                includeDirectories[includeDirTop++] = argv[++i];
+                includeDirectories = newList(argv[++i], includeDirectories);
             }
         }
         else if ((argv[i][0] == '-') && (argv[i][1] == 'm'))
@@ -767,25 +798,57 @@ int main(int argc, char** argv)
         {
             initialStaticMemorySize = atoi(argv[++i]);
         }
+        else if ((argv[i][0] == '-') && (argv[i][1] == 'f'))
+        {
+            initialFrameStackSize = atoi(argv[++i]);
+        }
         else if (argv[i][0] == '-')
         {
             yyserror("unknown option %s", argv[i]);
         }
+        else if (inputFileName)
+        {
+            yyserror("more than one input file specified: %s", argv[i]);
+        }
         else
         {
-            openInputFile(argv[i]);
-            gcinit(initialStaticMemorySize,initialMemorySize);
+            inputFileName = argv[i];
+        }
+    }
 
-            // Create global symbol table
-            globalSyms = syms = initialCreation();
+    if (imageName)
+    {
+        // Static memory is sized from the image once it has been read
+        beginImage
+        (
+            imageName,
+            initialStaticMemorySize,
+            initialMemorySize,
+            initialFrameStackSize
+        );
+        exit(0);
+    }
 
-            // Parse program
-            yyparse();
-            exit(0);
-        }
+    if (inputFileName == 0)
+    {
+        yyerror("no input file specified");
     }
 
-    yyerror("no input file specified");
+    includeDirectories = reverse(includeDirectories);
+    openInputFile(inputFileName);
+    gcinit
+    (
+        initialStaticMemorySize,
+        initialMemorySize,
+        initialFrameStackSize
+    );
+
+    // Create global symbol table
+    globalSyms = syms = initialCreation();
+
+    // Parse program
+    yyparse();
+    exit(0);
 }
 
 
@@ -0,0 +1,1024 @@
+/// Copyright 1993-2015 Timothy A. Budd
+// -----------------------------------------------------------------------------
+//  This file is part of
+/// ---     Leda: Multiparadigm Programming Language
+// -----------------------------------------------------------------------------
+//
+//  Leda is free software: you can redistribute it and/or modify it under the
+//  terms of the MIT license, see file "COPYING" included in this distribution.
+//
+// -----------------------------------------------------------------------------
+/// Title: Program images
+///  Description:
+//    A program image holds everything the interpreter needs once a
+//    program has been parsed, checked and initialized: the statement
+//    and expression records, the strings they refer to, and the static
+//    memory space (global context, class tables and constants).
+//    Loading an image skips the parse and the construction of the
+//    class tables entirely.
+//
+//    Records are written with their pointers replaced by indices,
+//    index zero standing for a null pointer.  Static memory is written
+//    as it stands, followed by a list of the slots that hold pointers
+//    and must be relocated when the image is read back.
+//
+//    Images are only meaningful to the lc executable that wrote them.
+// -----------------------------------------------------------------------------
+
+#include "lc.h"
+#include "interp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memory.h"
+
+# define IMAGEMAGIC 0x4c454441  // "LEDA"
+# define IMAGEVERSION 5
+
+enum relocations
+{
+    staticRelocation,
+    statementRelocation,
+    stringRelocation,
+};
+
+
+// -----------------------------------------------------------------------------
+///  Pointer tables
+// -----------------------------------------------------------------------------
+//- Each kind of record saved is numbered in the order it is first seen
+
+struct pointerTable
+{
+    void** keys;
+    int* indices;
+    int capacity;
+    void** items;
+    int count;
+};
+
+static int lookupPointer(struct pointerTable* t, void* p)
+{
+    if (t->capacity == 0)
+    {
+        return 0;
+    }
+
+    unsigned long h = ((unsigned long) p >> 3) & (t->capacity - 1);
+    while (t->keys[h])
+    {
+        if (t->keys[h] == p)
+        {
+            return t->indices[h];
+        }
+        h = (h + 1) & (t->capacity - 1);
+    }
+
+    return 0;
+}
+
+static void growPointerTable(struct pointerTable* t)
+{
+    int oldCapacity = t->capacity;
+    void** oldKeys = t->keys;
+    int* oldIndices = t->indices;
+
+    t->capacity = oldCapacity ? 2*oldCapacity : 1024;
+    t->keys = (void**) calloc(t->capacity, sizeof(void*));
+    t->indices = (int*) calloc(t->capacity, sizeof(int));
+    t->items = (void**) realloc(t->items, t->capacity*sizeof(void*));
+    if ((t->keys == 0) || (t->indices == 0) || (t->items == 0))
+    {
+        yyerror("out of memory writing image");
+    }
+
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        if (oldKeys[i])
+        {
+            unsigned long h =
+                ((unsigned long) oldKeys[i] >> 3) & (t->capacity - 1);
+            while (t->keys[h])
+            {
+                h = (h + 1) & (t->capacity - 1);
+            }
+            t->keys[h] = oldKeys[i];
+            t->indices[h] = oldIndices[i];
+        }
+    }
+
+    free(oldKeys);
+    free(oldIndices);
+}
+
+//- Returns the index of p, adding it if it has not been seen.
+//  Sets *isNew when p is added
+static int addPointer(struct pointerTable* t, void* p, int* isNew)
+{
+    *isNew = 0;
+    if (p == 0)
+    {
+        return 0;
+    }
+
+    int index = lookupPointer(t, p);
+    if (index)
+    {
+        return index;
+    }
+
+    if (2*(t->count + 1) > t->capacity)
+    {
+        growPointerTable(t);
+    }
+
+    unsigned long h = ((unsigned long) p >> 3) & (t->capacity - 1);
+    while (t->keys[h])
+    {
+        h = (h + 1) & (t->capacity - 1);
+    }
+    t->keys[h] = p;
+    t->items[t->count] = p;
+    t->indices[h] = ++t->count;
+    *isNew = 1;
+
+    return t->count;
+}
+
+static struct pointerTable statementTable;
+static struct pointerTable expressionTable;
+static struct pointerTable stringTable;
+
+
+// -----------------------------------------------------------------------------
+///  Collecting the code
+// -----------------------------------------------------------------------------
+
+static void collectStatement(struct statementRecord*);
+
+static void collectString(char* s)
+{
+    int isNew;
+    addPointer(&stringTable, s, &isNew);
+}
+
+static void collectExpression(struct expressionRecord* e)
+{
+    int isNew;
+    addPointer(&expressionTable, e, &isNew);
+    if (!isNew)
+    {
+        return;
+    }
+
+    struct expressionRecord** args = 0;
+    int nargs = 0;
+
+    switch (e->operator)
+    {
+        case getCurrentContext:
+            break;
+
+        case getOffset:
+        case getGlobalOffset:
+        case makeReference:
+        case makeMethodContext:
+        case evalThunk:
+        case evalReference:
+        case getLocal:
+        case getSelfField:
+        case checkDefined:
+            collectExpression(e->u.o.base);
+            collectString(e->u.o.symbol);
+            break;
+
+        case genIntegerConstant:
+        case genRealConstant:
+            break;
+
+        case genStringConstant:
+            collectString(e->u.s.value);
+            break;
+
+        case loadConstant:
+            // The value is collected with static memory
+            break;
+
+        case assignment:
+        case commaOp:
+        case assignLocal:
+        case assignSelfField:
+            collectExpression(e->u.a.left);
+            collectExpression(e->u.a.right);
+            collectString(e->u.a.symbol);
+            break;
+
+        case makeClosure:
+            collectExpression(e->u.l.context);
+            collectStatement(e->u.l.code);
+            collectString(e->u.l.functionName);
+            break;
+
+        case doFunctionCall:
+            collectExpression(e->u.f.fun);
+            collectString(e->u.f.symbol);
+            args = e->u.f.args;
+            nargs = e->u.f.nargs;
+            break;
+
+        case doSpecialCall:
+            args = e->u.c.args;
+            nargs = e->u.c.nargs;
+            break;
+
+        case buildInstance:
+            collectExpression(e->u.n.table);
+            args = e->u.n.args;
+            nargs = e->u.n.nargs;
+            break;
+
+        case patternMatch:
+            collectExpression(e->u.p.base);
+            collectExpression(e->u.p.class);
+            args = e->u.p.args;
+            nargs = e->u.p.nargs;
+            break;
+
+        default:
+            yyerror("compiler error -- unknown expression in image");
+    }
+
+    for (int i = 0; i < nargs; i++)
+    {
+        collectExpression(args[i]);
+    }
+}
+
+static void collectStatement(struct statementRecord* s)
+{
+    int isNew;
+
+    // Follow the chain of statements iteratively, only the
+    // branches of conditionals are followed recursively
+    for (; s; s = s->next)
+    {
+        addPointer(&statementTable, s, &isNew);
+        if (!isNew)
+        {
+            return;
+        }
+
+        collectString(s->fileName);
+        switch (s->statementType)
+        {
+            case expressionStatement:
+            case returnStatement:
+            case tailCall:
+                collectExpression(s->u.r.e);
+                break;
+
+            case conditionalStatement:
+                collectExpression(s->u.c.expr);
+                collectStatement(s->u.c.falsePart);
+                break;
+
+            case countedLoopStatement:
+                collectExpression(s->u.l.expr);
+                collectExpression(s->u.l.counter);
+                collectExpression(s->u.l.limit);
+                collectStatement(s->u.l.falsePart);
+                break;
+
+            case functionEntryStatement:
+            case nullStatement:
+                break;
+
+            default:
+                yyerror("compiler error -- unknown statement in image");
+        }
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+///  Collecting static memory
+// -----------------------------------------------------------------------------
+//- Static objects are found by tracing from the interpreter roots.
+//  A pointer held in static memory either refers to another static
+//  object or, in the global context and the class tables, to code
+
+struct relocation
+{
+    long offset;        // byte offset of the slot within static memory
+    int kind;
+    long value;         // byte offset or record index
+};
+
+static struct ledaValue* staticStart;
+static int staticUnits;
+static char* staticSeen;
+static struct relocation* relocations;
+static int relocationCount;
+static int relocationCapacity;
+
+static int inStaticImage(struct ledaValue* p)
+{
+    return (p >= staticStart) && (p < staticStart + staticUnits);
+}
+
+static void addRelocation(struct ledaValue** slot, int kind, long value)
+{
+    if (relocationCount == relocationCapacity)
+    {
+        relocationCapacity = relocationCapacity ? 2*relocationCapacity : 256;
+        relocations = (struct relocation*) realloc
+        (
+            relocations,
+            relocationCapacity*sizeof(struct relocation)
+        );
+        if (relocations == 0)
+        {
+            yyerror("out of memory writing image");
+        }
+    }
+
+    relocations[relocationCount].offset = (char*) slot - (char*) staticStart;
+    relocations[relocationCount].kind = kind;
+    relocations[relocationCount].value = value;
+    relocationCount++;
+}
+
+static void collectStaticObject(struct ledaValue*, struct ledaValue*);
+
+static void collectStaticSlot
+(
+    struct ledaValue** slot,
+    struct ledaValue* stringClass
+)
+{
+    struct ledaValue* p = *slot;
+    if (p == 0)
+    {
+        return;
+    }
+
+    if (inStaticImage(p))
+    {
+        addRelocation(slot, staticRelocation, (char*) p - (char*) staticStart);
+        collectStaticObject(p, stringClass);
+    }
+    else
+    {
+        struct statementRecord* code = (struct statementRecord*) p;
+        collectStatement(code);
+        addRelocation
+        (
+            slot,
+            statementRelocation,
+            lookupPointer(&statementTable, code)
+        );
+    }
+}
+
+static void collectStaticObject
+(
+    struct ledaValue* obj,
+    struct ledaValue* stringClass
+)
+{
+    if (staticSeen[obj - staticStart])
+    {
+        return;
+    }
+    staticSeen[obj - staticStart] = 1;
+
+    if (obj->size & 02)
+    {
+        // Binary values: class, context, then the value itself
+        collectStaticSlot(&obj->data[0], stringClass);
+        collectStaticSlot(&obj->data[1], stringClass);
+        if (obj->data[0] == stringClass)
+        {
+            char* s = (char*) obj->data[2];
+            collectString(s);
+            addRelocation
+            (
+                &obj->data[2],
+                stringRelocation,
+                lookupPointer(&stringTable, s)
+            );
+        }
+        return;
+    }
+
+    int sz = obj->size >> 2;
+    for (int i = 0; i < sz; i++)
+    {
+        collectStaticSlot(&obj->data[i], stringClass);
+    }
+
+    // The slot following the last is reserved by staticAllocate, and
+    // the true and false objects keep their context there
+    if (inStaticImage(obj->data[sz]))
+    {
+        collectStaticSlot(&obj->data[sz], stringClass);
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+///  Writing the image
+// -----------------------------------------------------------------------------
+
+static FILE* imageFile;
+
+static void putInt(long i)
+{
+    fwrite(&i, sizeof(long), 1, imageFile);
+}
+
+static void putIndex(struct pointerTable* t, void* p)
+{
+    putInt(lookupPointer(t, p));
+}
+
+static void putArguments(int nargs, struct expressionRecord** args)
+{
+    putInt(nargs);
+    for (int i = 0; i < nargs; i++)
+    {
+        putIndex(&expressionTable, args[i]);
+    }
+}
+
+static void putExpression(struct expressionRecord* e)
+{
+    putInt(e->operator);
+    switch (e->operator)
+    {
+        case getCurrentContext:
+            break;
+
+        case getOffset:
+        case getGlobalOffset:
+        case makeReference:
+        case makeMethodContext:
+        case evalThunk:
+        case evalReference:
+        case getLocal:
+        case getSelfField:
+        case checkDefined:
+            putInt(e->u.o.location);
+            putIndex(&expressionTable, e->u.o.base);
+            putIndex(&stringTable, e->u.o.symbol);
+            break;
+
+        case genIntegerConstant:
+            putInt(e->u.i.value);
+            break;
+
+        case genRealConstant:
+            fwrite(&e->u.r.value, sizeof(double), 1, imageFile);
+            break;
+
+        case genStringConstant:
+            putIndex(&stringTable, e->u.s.value);
+            break;
+
+        case loadConstant:
+            putInt((char*) e->u.v.value - (char*) staticStart);
+            break;
+
+        case assignment:
+        case commaOp:
+        case assignLocal:
+        case assignSelfField:
+            putIndex(&expressionTable, e->u.a.left);
+            putIndex(&expressionTable, e->u.a.right);
+            putIndex(&stringTable, e->u.a.symbol);
+            break;
+
+        case makeClosure:
+            putIndex(&expressionTable, e->u.l.context);
+            putIndex(&statementTable, e->u.l.code);
+            putIndex(&stringTable, e->u.l.functionName);
+            break;
+
+        case doFunctionCall:
+            putIndex(&expressionTable, e->u.f.fun);
+            putIndex(&stringTable, e->u.f.symbol);
+            putArguments(e->u.f.nargs, e->u.f.args);
+            break;
+
+        case doSpecialCall:
+            putInt(e->u.c.index);
+            putArguments(e->u.c.nargs, e->u.c.args);
+            break;
+
+        case buildInstance:
+            putIndex(&expressionTable, e->u.n.table);
+            putInt(e->u.n.size);
+            putArguments(e->u.n.nargs, e->u.n.args);
+            break;
+
+        case patternMatch:
+            putIndex(&expressionTable, e->u.p.base);
+            putIndex(&expressionTable, e->u.p.class);
+            putArguments(e->u.p.nargs, e->u.p.args);
+            break;
+    }
+}
+
+static void putStatement(struct statementRecord* s)
+{
+    putIndex(&stringTable, s->fileName);
+    putInt(s->lineNumber);
+    putInt(s->statementType);
+    putIndex(&statementTable, s->next);
+    switch (s->statementType)
+    {
+        case expressionStatement:
+        case returnStatement:
+        case tailCall:
+            putIndex(&expressionTable, s->u.r.e);
+            break;
+
+        case conditionalStatement:
+            putIndex(&expressionTable, s->u.c.expr);
+            putIndex(&statementTable, s->u.c.falsePart);
+            break;
+
+        case countedLoopStatement:
+            putIndex(&expressionTable, s->u.l.expr);
+            putIndex(&statementTable, s->u.l.falsePart);
+            putIndex(&expressionTable, s->u.l.counter);
+            putIndex(&expressionTable, s->u.l.limit);
+            break;
+
+        case functionEntryStatement:
+            putInt(s->u.k.size);
+            putInt(s->u.k.escapes);
+            putInt(s->u.k.primitive);
+            break;
+
+        case nullStatement:
+            break;
+    }
+}
+
+void saveImage
+(
+    char* name,
+    struct ledaValue** roots[],
+    struct statementRecord* firstStatement
+)
+{
+    // Gather everything reachable from the roots
+    collectStatement(firstStatement);
+
+    staticStart = staticInUse(&staticUnits);
+    staticSeen = (char*) calloc(staticUnits + 1, 1);
+    if (staticSeen == 0)
+    {
+        yyerror("out of memory writing image");
+    }
+
+    struct ledaValue* stringClass = *roots[0];
+    for (int i = 0; roots[i]; i++)
+    {
+        struct ledaValue* p = *roots[i];
+        if (p && !inStaticImage(p))
+        {
+            yyerror("cannot save image: value outside of static memory");
+        }
+        if (p)
+        {
+            collectStaticObject(p, stringClass);
+        }
+    }
+
+    // Values computed before the program was run, this may find more
+    // code and so more of them
+    for (int i = 0; i < expressionTable.count; i++)
+    {
+        struct expressionRecord* e =
+            (struct expressionRecord*) expressionTable.items[i];
+        if (e->operator == loadConstant)
+        {
+            if (!inStaticImage(e->u.v.value))
+            {
+                yyerror("cannot save image: value outside of static memory");
+            }
+            collectStaticObject(e->u.v.value, stringClass);
+        }
+    }
+
+    imageFile = fopen(name, "wb");
+    if (imageFile == NULL)
+    {
+        yyserror("unable to write image file %s", name);
+    }
+
+    putInt(IMAGEMAGIC);
+    putInt(IMAGEVERSION);
+    putInt(sizeof(struct ledaValue*));
+
+    // The strings
+    putInt(stringTable.count);
+    for (int i = 0; i < stringTable.count; i++)
+    {
+        char* s = (char*) stringTable.items[i];
+        int len = strlen(s);
+        putInt(len);
+        fwrite(s, 1, len, imageFile);
+    }
+
+    // The code
+    putInt(expressionTable.count);
+    putInt(statementTable.count);
+    for (int i = 0; i < expressionTable.count; i++)
+    {
+        putExpression((struct expressionRecord*) expressionTable.items[i]);
+    }
+    for (int i = 0; i < statementTable.count; i++)
+    {
+        putStatement((struct statementRecord*) statementTable.items[i]);
+    }
+
+    // Static memory and the slots in it that must be relocated
+    putInt(staticUnits);
+    fwrite(staticStart, sizeof(struct ledaValue), staticUnits, imageFile);
+    putInt(relocationCount);
+    for (int i = 0; i < relocationCount; i++)
+    {
+        putInt(relocations[i].offset);
+        putInt(relocations[i].kind);
+        putInt(relocations[i].value);
+    }
+
+    // The interpreter roots and the program itself
+    for (int i = 0; roots[i]; i++)
+    {
+        struct ledaValue* p = *roots[i];
+        putInt(p ? (char*) p - (char*) staticStart : -1);
+    }
+    putIndex(&statementTable, firstStatement);
+
+    if (ferror(imageFile))
+    {
+        yyserror("error writing image file %s", name);
+    }
+    fclose(imageFile);
+}
+
+
+// -----------------------------------------------------------------------------
+///  Reading the image
+// -----------------------------------------------------------------------------
+
+static char* imageName;
+static char** strings;
+static long stringCount;
+static struct expressionRecord* expressions;
+static long expressionCount;
+static struct statementRecord* statements;
+static long statementCount;
+
+static long getInt()
+{
+    long i;
+    if (fread(&i, sizeof(long), 1, imageFile) != 1)
+    {
+        yyserror("image file %s is truncated", imageName);
+    }
+    return i;
+}
+
+static long getIndex(long limit)
+{
+    long i = getInt();
+    if ((i < 0) || (i > limit))
+    {
+        yyserror("image file %s is damaged", imageName);
+    }
+    return i;
+}
+
+static char* getString()
+{
+    long i = getIndex(stringCount);
+    return i ? strings[i-1] : 0;
+}
+
+static struct expressionRecord* getExpression()
+{
+    long i = getIndex(expressionCount);
+    return i ? &expressions[i-1] : 0;
+}
+
+static struct statementRecord* getStatement()
+{
+    long i = getIndex(statementCount);
+    return i ? &statements[i-1] : 0;
+}
+
+static struct expressionRecord** getArguments(int* nargs)
+{
+    *nargs = getInt();
+    struct expressionRecord** args = (struct expressionRecord**)
+        malloc((*nargs + 1)*sizeof(struct expressionRecord*));
+    if (args == 0)
+    {
+        yyerror("out of memory reading image");
+    }
+    for (int i = 0; i < *nargs; i++)
+    {
+        args[i] = getExpression();
+    }
+    args[*nargs] = 0;
+    return args;
+}
+
+static void getExpressionRecord(struct expressionRecord* e)
+{
+    e->operator = getInt();
+    e->resultType = 0;
+    switch (e->operator)
+    {
+        case getCurrentContext:
+            break;
+
+        case getOffset:
+        case getGlobalOffset:
+        case makeReference:
+        case makeMethodContext:
+        case evalThunk:
+        case evalReference:
+        case getLocal:
+        case getSelfField:
+        case checkDefined:
+            e->u.o.location = getInt();
+            e->u.o.base = getExpression();
+            e->u.o.symbol = getString();
+            break;
+
+        case genIntegerConstant:
+            e->u.i.value = getInt();
+            break;
+
+        case genRealConstant:
+            if (fread(&e->u.r.value, sizeof(double), 1, imageFile) != 1)
+            {
+                yyserror("image file %s is truncated", imageName);
+            }
+            break;
+
+        case genStringConstant:
+            e->u.s.value = getString();
+            break;
+
+        case loadConstant:
+            // Holds the offset in static memory until that is read
+            e->u.v.value = (struct ledaValue*) getInt();
+            break;
+
+        case assignment:
+        case commaOp:
+        case assignLocal:
+        case assignSelfField:
+            e->u.a.left = getExpression();
+            e->u.a.right = getExpression();
+            e->u.a.symbol = getString();
+            break;
+
+        case makeClosure:
+            e->u.l.context = getExpression();
+            e->u.l.code = getStatement();
+            e->u.l.functionName = getString();
+            break;
+
+        case doFunctionCall:
+            e->u.f.fun = getExpression();
+            e->u.f.symbol = getString();
+            e->u.f.args = getArguments(&e->u.f.nargs);
+            break;
+
+        case doSpecialCall:
+            e->u.c.index = getInt();
+            e->u.c.args = getArguments(&e->u.c.nargs);
+            break;
+
+        case buildInstance:
+            e->u.n.table = getExpression();
+            e->u.n.size = getInt();
+            e->u.n.args = getArguments(&e->u.n.nargs);
+            break;
+
+        case patternMatch:
+            e->u.p.base = getExpression();
+            e->u.p.class = getExpression();
+            e->u.p.args = getArguments(&e->u.p.nargs);
+            break;
+
+        default:
+            yyserror("image file %s is damaged", imageName);
+    }
+}
+
+static void getStatementRecord(struct statementRecord* s)
+{
+    s->fileName = getString();
+    s->lineNumber = getInt();
+    s->statementType = getInt();
+    s->next = getStatement();
+    switch (s->statementType)
+    {
+        case expressionStatement:
+        case returnStatement:
+        case tailCall:
+            s->u.r.e = getExpression();
+            break;
+
+        case conditionalStatement:
+            s->u.c.expr = getExpression();
+            s->u.c.falsePart = getStatement();
+            break;
+
+        case countedLoopStatement:
+            s->u.l.expr = getExpression();
+            s->u.l.falsePart = getStatement();
+            s->u.l.counter = getExpression();
+            s->u.l.limit = getExpression();
+            break;
+
+        case functionEntryStatement:
+            s->u.k.size = getInt();
+            s->u.k.escapes = getInt();
+            s->u.k.primitive = getInt();
+            break;
+
+        case nullStatement:
+            break;
+
+        default:
+            yyserror("image file %s is damaged", imageName);
+    }
+}
+
+//- Initializes memory management itself, once the size of the saved static
+//  memory is known
+struct statementRecord* loadImage
+(
+    char* name,
+    struct ledaValue** roots[],
+    int staticsz,
+    int dynamicsz,
+    int framesz
+)
+{
+    imageName = name;
+    imageFile = fopen(name, "rb");
+    if (imageFile == NULL)
+    {
+        yyserror("unable to open image file %s", name);
+    }
+
+    if
+    (
+        (getInt() != IMAGEMAGIC)
+     || (getInt() != IMAGEVERSION)
+     || (getInt() != sizeof(struct ledaValue*))
+    )
+    {
+        yyserror("%s is not an image file for this version of lc", name);
+    }
+
+    // The strings
+    stringCount = getInt();
+    strings = (char**) malloc((stringCount + 1)*sizeof(char*));
+    if (strings == 0)
+    {
+        yyerror("out of memory reading image");
+    }
+    for (long i = 0; i < stringCount; i++)
+    {
+        long len = getInt();
+        strings[i] = (char*) malloc(len + 1);
+        if
+        (
+            (strings[i] == 0)
+         || (fread(strings[i], 1, len, imageFile) != len)
+        )
+        {
+            yyserror("image file %s is truncated", name);
+        }
+        strings[i][len] = '\0';
+    }
+
+    // The code
+    expressionCount = getInt();
+    statementCount = getInt();
+    expressions = (struct expressionRecord*)
+        calloc(expressionCount + 1, sizeof(struct expressionRecord));
+    statements = (struct statementRecord*)
+        calloc(statementCount + 1, sizeof(struct statementRecord));
+    if ((expressions == 0) || (statements == 0))
+    {
+        yyerror("out of memory reading image");
+    }
+    for (long i = 0; i < expressionCount; i++)
+    {
+        getExpressionRecord(&expressions[i]);
+    }
+    for (long i = 0; i < statementCount; i++)
+    {
+        getStatementRecord(&statements[i]);
+    }
+
+    // Static memory, which is placed at the same offsets as when saved
+    long units = getInt();
+    if (units < 2)
+    {
+        yyserror("image file %s is damaged", name);
+    }
+    gcinit(units > staticsz ? units : staticsz, dynamicsz, framesz);
+    struct ledaValue* base = staticAllocate(units - 2);
+    if (fread(base, sizeof(struct ledaValue), units, imageFile) != units)
+    {
+        yyserror("image file %s is truncated", name);
+    }
+
+    long count = getInt();
+    for (long i = 0; i < count; i++)
+    {
+        long offset = getInt();
+        long kind = getInt();
+        long value = getInt();
+        if
+        (
+            (offset < 0)
+         || (offset > (units - 1)*sizeof(struct ledaValue))
+        )
+        {
+            yyserror("image file %s is damaged", name);
+        }
+
+        struct ledaValue** slot =
+            (struct ledaValue**) ((char*) base + offset);
+        switch (kind)
+        {
+            case staticRelocation:
+                *slot = (struct ledaValue*) ((char*) base + value);
+                break;
+
+            case statementRelocation:
+                if ((value < 1) || (value > statementCount))
+                {
+                    yyserror("image file %s is damaged", name);
+                }
+                *slot = (struct ledaValue*) &statements[value-1];
+                break;
+
+            case stringRelocation:
+                if ((value < 1) || (value > stringCount))
+                {
+                    yyserror("image file %s is damaged", name);
+                }
+                *slot = (struct ledaValue*) strings[value-1];
+                break;
+
+            default:
+                yyserror("image file %s is damaged", name);
+        }
+    }
+
+    for (long i = 0; i < expressionCount; i++)
+    {
+        struct expressionRecord* e = &expressions[i];
+        if (e->operator == loadConstant)
+        {
+            long offset = (long) e->u.v.value;
+            if ((offset < 0) || (offset > (units - 1)*sizeof(struct ledaValue)))
+            {
+                yyserror("image file %s is damaged", name);
+            }
+            e->u.v.value = (struct ledaValue*) ((char*) base + offset);
+        }
+    }
+
+    // The interpreter roots and the program itself
+    for (int i = 0; roots[i]; i++)
+    {
+        long offset = getInt();
+        *roots[i] =
+            (offset < 0) ? 0 : (struct ledaValue*) ((char*) base + offset);
+    }
+    struct statementRecord* firstStatement = getStatement();
+
+    fclose(imageFile);
+
+    return firstStatement;
+}
+
+
+// -----------------------------------------------------------------------------
@@ -18,6 +18,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
 #include "memory.h"
 
 // -----------------------------------------------------------------------------
@@ -41,6 +43,9 @@ extern char*    fileName;
 
 static int doingInitialization = 1;
 
+// Name of the image file to write once initialization is complete
+char* imageFileName = 0;
+
 // -----------------------------------------------------------------------------
 ///  Building initial table
 // -----------------------------------------------------------------------------
@@ -132,6 +137,52 @@ char* specialFunctionNames[] =
     "Leda_real_less",       // 28
     "Leda_real_asInteger",  // 29
     "Leda_real_equals",     // 30
+    "Leda_string_hash",     // 31
+    "Leda_hash_find",       // 32
+    "Leda_object_copy",     // 33
+    "Leda_object_sort",     // 34
+    "Leda_object_fill",     // 35
+    "Leda_object_reverse",  // 36
+    "Leda_object_index",    // 37
+    "Leda_unboxed_allocate", // 38
+    "Leda_int_at",          // 39
+    "Leda_int_atPut",       // 40
+    "Leda_real_at",         // 41
+    "Leda_real_atPut",      // 42
+    "Leda_int_sum",         // 43
+    "Leda_real_sum",        // 44
+    "Leda_int_minimum",     // 45
+    "Leda_int_maximum",     // 46
+    "Leda_real_minimum",    // 47
+    "Leda_real_maximum",    // 48
+    "Leda_int_dot",         // 49
+    "Leda_real_dot",        // 50
+    "Leda_int_add",         // 51
+    "Leda_real_add",        // 52
+    "Leda_int_scale",       // 53
+    "Leda_real_scale",      // 54
+    "Leda_int_prefixSum",   // 55
+    "Leda_real_prefixSum",  // 56
+    "Leda_heap_add",        // 57
+    "Leda_heap_removeFirst", // 58
+    "Leda_random_seed",     // 59
+    "Leda_random_split",    // 60
+    "Leda_random_integer",  // 61
+    "Leda_random_real",     // 62
+    "Leda_random_fillIntegers", // 63
+    "Leda_random_fillReals", // 64
+    "Leda_random_buildAlias", // 65
+    "Leda_random_weighted", // 66
+    "Leda_string_break",    // 67
+    "Leda_string_span",     // 68
+    "Leda_string_charIn",   // 69
+    "Leda_string_matchAt",  // 70
+    "Leda_string_tokenCount", // 71
+    "Leda_string_tokens",   // 72
+    "Leda_integer_print",   // 73
+    "Leda_real_print",      // 74
+    "Leda_real_asExactString", // 75
+    "Leda_unboxed_copy",    // 76
     0
 };
 
@@ -202,8 +253,16 @@ static struct ledaValue* newIntegerConstant(int i)
 // only single precision floating point values are used
 static struct ledaValue* newRealConstant(float r)
 {
-    struct ledaValue* result = gcalloc(2);
-    result->size |= 02; // turn on binary flag
+    struct ledaValue* result;
+    if (doingInitialization)
+    {
+        result = staticAllocate(2);
+    }
+    else
+    {
+        result = gcalloc(2);
+    }
+    result->size = 10; // 2 << 2 + 02
     result->data[0] = realClass;
     result->data[1] = globalContext;
     float* dp = (float*) & result->data[2];
@@ -219,6 +278,14 @@ static float realValue(struct ledaValue* d)
 }
 
 
+//- Integers (and reference offsets) are stored as by binaryValue
+static int intValue(struct ledaValue* d)
+{
+    int* ip = (int*) &d->data[2];
+    return *ip;
+}
+
+
 static struct ledaValue* newStringConstant(char* p)
 {
     struct ledaValue* result;
@@ -238,1052 +305,830 @@ static struct ledaValue* newStringConstant(char* p)
     return result;
 }
 
-static struct ledaValue* evaluateStatement(struct statementRecord* s);
-static struct ledaValue* evaluateExpression(struct expressionRecord* e);
 
-static struct ledaValue* evaluateSpecial
-(
-    int index,
-    struct list* args
-)
+// -----------------------------------------------------------------------------
+///  Hash tables
+// -----------------------------------------------------------------------------
+//- The keys of a HashTable (see std.led) are held in a block of slots
+//  searched by linear probing.  Integer, real and string keys are
+//  compared here, other keys are left to their equals method
+
+static int stringHash(char* p)
 {
-    struct ledaValue* result = 0;
-    struct ledaValue* a;
-    struct ledaValue* b;
-    float r1;
-
-    switch(index) {
-        case 0:     // object equality
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            if (a == b)
-                result = trueObject;
-            else
-                result = falseObject;
-            break;
+    unsigned int h = 2166136261u;
+    while (*p)
+    {
+        h = (h ^ (unsigned char) *p++) * 16777619u;
+    }
+    return h & 0x7fffffff;
+}
 
-        case 1:     // string compare
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            result = newIntegerConstant
-            (
-                strcmp((char*) a->data[2],
-                (char*) b->data[2])
-            );
-            break;
 
-        case 2:     // string print
-            result = evaluateExpression((struct expressionRecord*) args->value);
-            printf("%s", (char*)result->data[2]);
-            result = 0;
-            break;
+//- True if a and b, of the same native class, hold equal values
+static int sameNativeKey(struct ledaValue* a, struct ledaValue* b)
+{
+    if (a->data[0] == integerClass)
+    {
+        return intValue(a) == intValue(b);
+    }
+    if (a->data[0] == realClass)
+    {
+        return realValue(a) == realValue(b);
+    }
+    return strcmp((char*) a->data[2], (char*) b->data[2]) == 0;
+}
 
-        case 3:     // string concat
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            {
-                char* buffer =
-                    (char*)malloc
-                    (
-                        strlen((char*) a->data[2])
-                      + strlen((char*) b->data[2])
-                      + 1
-                    );
-                if (buffer == 0)
-                {
-                    yyerror("out of memory");
-                }
-                strcpy(buffer, (char*) a->data[2]);
-                strcat(buffer, (char*) b->data[2]);
-                result = newStringConstant(buffer);
-            }
-            break;
 
-        case 4:     // integer equals
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            if (((int) a->data[2]) == ((int) b->data[2]))
-            {
-                result = trueObject;
-            }
-            else
-            {
-                result = falseObject;
-            }
-            break;
+static int isNativeKey(struct ledaValue* v)
+{
+    return
+        (v->data[0] == integerClass)
+     || (v->data[0] == realClass)
+     || (v->data[0] == stringClass);
+}
 
-        case 5:     // integer add
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            result = newIntegerConstant
-            (
-                ((int) a->data[2]) + ((int) b->data[2])
-            );
-            break;
 
-        case 6:     // integer minus
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            result = newIntegerConstant
-            (
-                ((int) a->data[2]) - ((int) b->data[2])
-            );
-            break;
+//- Starting at position, the slot that is empty or holds key.
+//  A slot holding a key that cannot be compared here is returned
+//  as -1 - slot
+static int hashFind
+(
+    struct ledaValue* keys,
+    int capacity,
+    struct ledaValue* key,
+    int position
+)
+{
+    int native = isNativeKey(key);
+    int slot = position % capacity;
+    if (slot < 0)
+    {
+        slot += capacity;
+    }
 
-        case 7:     // integer times
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            result = newIntegerConstant
-            (
-                ((int) a->data[2]) * ((int) b->data[2])
-            );
-            break;
+    for (int n = 0; n < capacity; n++)
+    {
+        struct ledaValue* k = keys->data[slot];
+        if ((k == 0) || (k == key))
+        {
+            return slot;
+        }
+        if (!native || (k->data[0] != key->data[0]))
+        {
+            return -1 - slot;
+        }
+        if (sameNativeKey(k, key))
+        {
+            return slot;
+        }
+        slot = (slot + 1 == capacity) ? 0 : slot + 1;
+    }
 
-        case 8:     // integer division
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            result = newIntegerConstant
-            (
-                ((int) a->data[2])/((int) b->data[2])
-            );
-            break;
+    yyerror("hash table is full");
+    return 0;
+}
 
-        case 9:     // integer as string
-            { char buffer[40];
-                result = evaluateExpression(
-                    (struct expressionRecord*) args->value);
-                sprintf(buffer,"%d", (int)result->data[2]);
-                result = newStringConstant(newString(buffer));
-            }
-            break;
 
-        case 10:    // integer less
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            if (((int) a->data[2]) < ((int) b->data[2]))
-            {
-                result = trueObject;
-            }
-            else
-            {
-                result = falseObject;
-            }
-            break;
+//- Activation records hold the arguments followed by the locals.
+//  They go on the frame stack, unless the compiler found that the
+//  function may capture its own context
+static struct ledaValue* newActivationRecord
+(
+    struct ledaValue* code,
+    int size
+)
+{
+    struct statementRecord* entry = (struct statementRecord*) code;
 
-        case 11:    // integer or
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            result = newIntegerConstant
-            (
-                ((int) a->data[2]) | ((int) b->data[2])
-            );
-            break;
+    if (entry->statementType == functionEntryStatement)
+    {
+        size = entry->u.k.size;
+        if (entry->u.k.escapes)
+        {
+            return gcalloc(size);
+        }
+    }
 
-        case 12:    // integer and
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            a = rootStack[--rootTop];
-            result = newIntegerConstant
-            (
-                ((int) a->data[2]) & ((int) b->data[2])
-            );
-            break;
+    return framealloc(size);
+}
 
-        case 13:    // integer invert
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            result = newIntegerConstant(~ (int) a->data[2]);
-            break;
 
-        case 14:        // integer as real
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            result = newRealConstant((float) (int) a->data[2]);
-            break;
+//- The cfunction call that makes up the whole body of a primitive
+//  method, or zero.  The call can be evaluated as soon as the
+//  activation record is built, without running the body
+static inline struct expressionRecord* primitiveBody(struct ledaValue* code)
+{
+    struct statementRecord* entry = (struct statementRecord*) code;
 
-        case 15:        // allocate new object
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            args = args->next;
-            result = gcalloc((int) a->data[2]);
-            a = rootStack[--rootTop];
-            // now fill in any argument values
-            {
-                int i = 0;
-                while (args != 0)
-                {
-                    a = evaluateExpression
-                    (
-                        (struct expressionRecord*) args->value
-                    );
-                    result->data[i++] = a;
-                    args = args->next;
-                }
-            }
-            break;
+    if
+    (
+        (entry->statementType == functionEntryStatement)
+     && entry->u.k.primitive
+    )
+    {
+        return entry->next->u.r.e;
+    }
 
-        case 16:        // index at
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            undefCheck(1, a, "subscript base");
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            undefCheck(2, b, "subscript index");
-            a = rootStack[--rootTop];
-            result = a->data[(int) b->data[2]];
-            break;
+    return 0;
+}
 
-        case 17:    // index at put
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            undefCheck(3, a, "subscript base");
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            undefCheck(4, b, "subscript index");
-            rootStack[rootTop++] = b;
-            {
-                struct ledaValue* c;
-                args = args->next;
-                c = evaluateExpression((struct expressionRecord*) args->value);
-                b = rootStack[--rootTop];
-                a = rootStack[--rootTop];
-                a->data[(int) b->data[2]] = c;
-            }
-            result = 0;
-            break;
 
-        case 18:    // just evaluate value
-            result = evaluateExpression((struct expressionRecord*) args->value);
-            break;
+// -----------------------------------------------------------------------------
+///  Unboxed arrays
+// -----------------------------------------------------------------------------
+//- IntArray and RealArray (see std.led) keep their elements in a binary
+//  block, packed one int or float to a cell starting at data[2].  The
+//  class and context slots of the block are left zero, the collector
+//  copies the cells without looking at them.  The loops over cells are
+//  kept simple enough for the C compiler to vectorize.  Cells are counted
+//  in ints, whatever the size of a pointer
+
+static struct ledaValue* newUnboxedBlock(int count)
+{
+    int slotSize = sizeof(struct ledaValue*);
+    int sz = 1 + (count * sizeof(int) + slotSize - 1) / slotSize;
+    struct ledaValue* block = gcalloc(sz);
+    block->size = (sz << 2) | 02;
+    memset(block->data, 0, (sz + 1) * sizeof(struct ledaValue*));
 
-        case 19:    // string length
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            undefCheck(5, a, "string length");
-            result = newIntegerConstant(strlen((char*) a->data[2]));
-            break;
+    return block;
+}
 
-        case 20:    // string substring
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = a;
-            undefCheck(6, a, "substring base");
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            rootStack[rootTop++] = b;
-            undefCheck(7, b, "substring start");
-            {
-                args = args->next;
-                struct ledaValue* c = evaluateExpression
-                (
-                    (struct expressionRecord*) args->value
-                );
-                undefCheck(8, c, "substring length");
-                char* buffer = (char*) malloc(1 + (int) c->data[2]);
-                char* p = buffer;
-                if (buffer == 0)
-                {
-                    yyerror("out of memory");
-                }
-                b = rootStack[--rootTop];
-                a = rootStack[--rootTop];
-                char* q = (char*) a->data[2];
-                int i;
-                for (q = &q[(int) b->data[2]], i = (int) c->data[2]; i > 0; i--)
-                {
-                    *p++ = *q++;
-                }
-                *p = '\0';
-                result = newStringConstant(buffer);
-            }
-            break;
 
-        case 21:    // stdin read
-            {
-                char buffer[256];
-                if (fgets(buffer, sizeof(buffer), stdin) == 0)
-                {
-                    result = 0;
-                }
-                else
-                {
-                    result = newStringConstant(newString(buffer));
-                }
-            }
-            break;
+//- The number of int cells a block holds, at least the count it was
+//  allocated for
+static int unboxedCapacity(struct ledaValue* block)
+{
+    return ((block->size >> 2) - 1) * sizeof(struct ledaValue*) / sizeof(int);
+}
 
-        case 22:    // is defined
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            if (a)
-                result = trueObject;
-            else
-                result = falseObject;
-            break;
 
+static inline int* intCells(struct ledaValue* block)
+{
+    return (int*) &block->data[2];
+}
 
-        case 23:    // real as string
-            {
-                char buffer[40];
-                result = evaluateExpression
-                (
-                    (struct expressionRecord*) args->value
-                );
-                sprintf(buffer,"%g",realValue(result));
-                result = newStringConstant(newString(buffer));
-            }
-            break;
 
-        case 24:    // real addition
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            r1 = realValue(a);
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            result = newRealConstant(r1 + realValue(b));
-            break;
+static inline float* realCells(struct ledaValue* block)
+{
+    return (float*) &block->data[2];
+}
 
-        case 25:    // real subtraction
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            r1 = realValue(a);
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            result = newRealConstant(r1 - realValue(b));
-            break;
 
-        case 26:    // real multiplication
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            r1 = realValue(a);
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            result = newRealConstant(r1 * realValue(b));
-            break;
+static int intSum(const int* x, int n)
+{
+    long total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        total += x[i];
+    }
+    return total;
+}
 
 
-        case 27:    // real division
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            r1 = realValue(a);
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            result = newRealConstant(r1 / realValue(b));
-            break;
+//- Four partial sums, so that the additions need not wait on each other
+static float realSum(const float* x, int n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += x[i];
+        s1 += x[i + 1];
+        s2 += x[i + 2];
+        s3 += x[i + 3];
+    }
+    for (; i < n; i++)
+    {
+        s0 += x[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
 
-        case 28:    // real comparison
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            r1 = realValue(a);
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            if (r1 < realValue(b))
-            {
-                result = trueObject;
-            }
-            else
-            {
-                result = falseObject;
-            }
-            break;
 
-        case 29:    // real as integer
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            result = newIntegerConstant((int) realValue(a));
-            break;
+static int intDot(const int* x, const int* y, int n)
+{
+    long total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        total += (long) x[i] * y[i];
+    }
+    return total;
+}
 
-        case 30:    // real equality
-            a = evaluateExpression((struct expressionRecord*) args->value);
-            r1 = realValue(a);
-            args = args->next;
-            b = evaluateExpression((struct expressionRecord*) args->value);
-            if (r1 == realValue(b))
-            {
-                result = trueObject;
-            }
-            else
-            {
-                result = falseObject;
-            }
-            break;
 
-        default:
-            printf("unimplemented special %d\n", index);
-            exit(1);
-            break;
+static float realDot(const float* x, const float* y, int n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += x[i] * y[i];
+        s1 += x[i + 1] * y[i + 1];
+        s2 += x[i + 2] * y[i + 2];
+        s3 += x[i + 3] * y[i + 3];
     }
-
-    return result;
+    for (; i < n; i++)
+    {
+        s0 += x[i] * y[i];
+    }
+    return (s0 + s1) + (s2 + s3);
 }
 
 
-static struct ledaValue* evaluateExpression
-(
-    struct expressionRecord* e
-)
+//- The cfunctions Leda_unboxed_allocate to Leda_real_prefixSum, and
+//  Leda_unboxed_copy, given their evaluated arguments.  Each takes a block, then an element
+//  index or a count of elements, then any other block or value
+static struct ledaValue* unboxedOperation(int index, struct ledaValue** args)
 {
-    register struct ledaValue* result;
-    register struct ledaValue* arg;
+    if (index == 38)    // allocate: count
+    {
+        undefCheck(51, args[0], "unboxed array size");
+        if (intValue(args[0]) < 0)
+        {
+            yyerror("unboxed array size is negative");
+        }
+        return newUnboxedBlock(intValue(args[0]));
+    }
+
+    undefCheck(40, args[0], "unboxed array");
+    undefCheck(51, args[1], "unboxed array index");
+    int* ix = intCells(args[0]);
+    float* rx = realCells(args[0]);
+    int n = intValue(args[1]);
+
+    // An element index must name a cell, a count may cover them all
+    int limit = unboxedCapacity(args[0]);
+    if (index <= 42)
+    {
+        limit--;
+    }
+    if ((n < 0) || (n > limit))
+    {
+        yyerror("unboxed array index out of range");
+    }
 
-    if (e == 0)
+    if ((index >= 49 && index <= 52) || (index == 76))
+    {
+        undefCheck(41, args[2], "unboxed array argument");
+        if (n > unboxedCapacity(args[2]))
+        {
+            yyerror("unboxed array index out of range");
+        }
+    }
+    if ((index == 40) || (index == 42) || (index == 53) || (index == 54))
     {
-        yyerror("internal run-time error: null expression");
+        undefCheck(50, args[2], "unboxed array value");
     }
 
-    switch(e->operator)
+    switch (index)
     {
+        case 39:    // int at
+            return newIntegerConstant(ix[n]);
 
-        case getCurrentContext:
-            if (displayOperators)
-            {
-                printf("getCurrentContext yields %p\n", currentContext);
-            }
-            return currentContext;
+        case 40:    // int at put
+            ix[n] = intValue(args[2]);
             break;
 
-        case getOffset:
-            if (e->u.o.base->operator == getCurrentContext)
-            {
-                arg = currentContext;
-            }
-            else
-            {
-                arg = evaluateExpression(e->u.o.base);
-                undefCheck(9, arg, e->u.o.symbol);
-            }
-            result = arg->data[e->u.o.location];
-            if (displayOperators)
+        case 41:    // real at
+            return newRealConstant(rx[n]);
+
+        case 42:    // real at put
+            rx[n] = realValue(args[2]);
+            break;
+
+        case 43:    // int sum
+            return newIntegerConstant(intSum(ix, n));
+
+        case 44:    // real sum
+            return newRealConstant(realSum(rx, n));
+
+        case 45:    // int minimum
+        case 46:    // int maximum
+            if (n > 0)
             {
-                printf
-                (
-                    "getOffset %d from %p yields %p\n",
-                    e->u.o.location, arg, result
-                );
+                int m = ix[0];
+                for (int i = 1; i < n; i++)
+                {
+                    int v = ix[i];
+                    m = (index == 45) ? (v < m ? v : m) : (v > m ? v : m);
+                }
+                return newIntegerConstant(m);
             }
             break;
 
-        case getGlobalOffset:
-            if (displayOperators)
+        case 47:    // real minimum
+        case 48:    // real maximum
+            if (n > 0)
             {
-                printf("get global offset %d\n", e->u.o.location);
+                float m = rx[0];
+                for (int i = 1; i < n; i++)
+                {
+                    float v = rx[i];
+                    m = (index == 47) ? (v < m ? v : m) : (v > m ? v : m);
+                }
+                return newRealConstant(m);
             }
-            result = globalContext->data[e->u.o.location];
             break;
 
-        case makeReference:
-            arg = evaluateExpression(e->u.o.base);
-            undefCheck(10, arg, e->u.a.symbol);
-            rootStack[rootTop++] = arg;
-            result = binaryValue(e->u.o.location);
-            arg = rootStack[--rootTop];
-            result->data[0] = arg;
-            break;
+        case 49:    // int dot
+            return newIntegerConstant(intDot(ix, intCells(args[2]), n));
 
-        case assignment:
-            if (e->u.a.left->operator == makeReference)
+        case 50:    // real dot
+            return newRealConstant(realDot(rx, realCells(args[2]), n));
+
+        case 51:    // int add
             {
-                if
-                (
-                    e->u.a.left->u.o.base->operator == getCurrentContext
-                )
+                const int* y = intCells(args[2]);
+                for (int i = 0; i < n; i++)
                 {
-                    arg = currentContext;
+                    ix[i] += y[i];
                 }
-                else
-                {
-                    arg = evaluateExpression(e->u.a.left->u.o.base);
-                    undefCheck(11, arg,
-                    e->u.a.left->u.a.symbol);
-                }
-                rootStack[rootTop++] = arg;
-                result = evaluateExpression(e->u.a.right);
-                arg = rootStack[--rootTop];
-                arg->data[e->u.a.left->u.o.location] = result;
-            }
-            else
-            {
-                arg = evaluateExpression(e->u.a.left);
-                rootStack[rootTop++] = arg;
-                result = evaluateExpression(e->u.a.right);
-                arg = rootStack[--rootTop];
-                arg->data[0]->data[(int) arg->data[2]] = result;
             }
-            if (displayOperators)
+            break;
+
+        case 52:    // real add
             {
-                printf("assignment gets %p\n", result);
+                const float* y = realCells(args[2]);
+                for (int i = 0; i < n; i++)
+                {
+                    rx[i] += y[i];
+                }
             }
-            result = 0;
             break;
 
-
-        case makeMethodContext:
-            // get the context
-            arg = evaluateExpression(e->u.o.base);
-            rootStack[rootTop++] = arg;
-            result = gcalloc(3);
-            arg = rootStack[--rootTop];
-            undefCheck(12, arg, e->u.o.symbol);
-            undefCheck(13, arg->data[0], "method table");
-            if (displayOperators)
+        case 53:    // int scale
             {
-                printf
-                (
-                    "make method %d context %p code\n",
-                    e->u.o.location, arg
-                    //(arg->data[0])[e->u.o.location]
-                );
-                printf("method table %p\n", arg->data[0]);
+                int k = intValue(args[2]);
+                for (int i = 0; i < n; i++)
+                {
+                    ix[i] *= k;
+                }
             }
-            result->data[1] = arg;
-            result->data[2] = (arg->data[0])->data[e->u.o.location];
             break;
 
-        case makeClosure:
-            result = gcalloc(2);
-            if (e->u.l.context->operator == getCurrentContext)
+        case 54:    // real scale
             {
-                arg = currentContext;
+                float k = realValue(args[2]);
+                for (int i = 0; i < n; i++)
+                {
+                    rx[i] *= k;
+                }
             }
-            else
+            break;
+
+        case 55:    // int prefix sum
+            for (int i = 1; i < n; i++)
             {
-                rootStack[rootTop++] = result;
-                arg = evaluateExpression(e->u.l.context);
-                result = rootStack[--rootTop];
-                undefCheck(14, arg, "<context>");
+                ix[i] += ix[i - 1];
             }
-            if (displayOperators)
+            break;
+
+        case 56:    // real prefix sum
+            for (int i = 1; i < n; i++)
             {
-                printf
-                (
-                    "make closure %p, context = %p code = %p\n",
-                    result, arg, e->u.l.code
-                );
+                rx[i] += rx[i - 1];
             }
-            result->data[1] = arg;
-            result->data[2] = (struct ledaValue*) e->u.l.code;
             break;
 
-        case doFunctionCall:
-            {
-                struct ledaValue* code;
-                struct ledaValue* context;
-                struct ledaValue* newContext;
+        case 76:    // copy the first count cells of another block
+            memmove(ix, intCells(args[2]), n * sizeof(int));
+            break;
+    }
 
-                char* functionName = e->u.f.symbol;
-                if (displayOperators)
-                {
-                    printf("beginning function call operator\n");
-                }
+    return 0;
+}
 
-                if (functionName == 0)
-                {
-                    functionName = " ? ";
-                }
 
-                if (e->u.f.fun->operator == makeClosure)
-                {
-                    if (e->u.f.fun->u.l.context->operator == getCurrentContext)
-                    {
-                        context = currentContext;
-                    }
-                    else
-                    {
-                        context = evaluateExpression(e->u.f.fun->u.l.context);
-                        undefCheck(15, context,"context");
-                    }
-                    code = (struct ledaValue*)e->u.f.fun->u.l.code;
-                }
-                else if (e->u.f.fun->operator == makeMethodContext)
-                {
-                    context = evaluateExpression(e->u.f.fun->u.o.base);
-                    undefCheck(16, context,"context");
-                    undefCheck(17, context->data[0],"method table");
-                    code = (context->data[0])->data
-                    [e->u.f.fun->u.o.location];
-                }
-                else
-                {
-                    arg = evaluateExpression(e->u.f.fun);
-                    undefCheck(18, arg, e->u.f.symbol);
-                    context = arg->data[1];
-                    code = arg->data[2];
-                }
+// -----------------------------------------------------------------------------
+///  Tokens
+// -----------------------------------------------------------------------------
 
-                // create the activation record
-                struct list* p = e->u.f.args;
+//- The start of the first token of text at or after position, or -1.
+//  Tokens are runs of characters not among the separators
+static int nextToken(char* text, int position, char* separators, int* end)
+{
+    int start = position + strspn(&text[position], separators);
+    if (text[start] == '\0')
+    {
+        return -1;
+    }
+    *end = start + strcspn(&text[start], separators);
+    return start;
+}
 
-                rootStack[rootTop++] = context;
-                newContext = gcalloc(length(p) + 4);
-                context = rootStack[--rootTop];
-                if (displayOperators)
-                {
-                    printf
-                    (
-                        "do function call (%p) fun context %p, "
-                        "new context %p args:\n",
-                        currentContext, context, newContext
-                    );
-                }
-                newContext->data[1] = context;
-                newContext->data[2] = currentContext;
-                for (int i=4 ; p ; i++,p = p->next)
-                {
-                    // tricky gc insurance
-                    rootStack[rootTop++] = newContext;
-                    arg = evaluateExpression
-                    (
-                        (struct expressionRecord*) p->value
-                    );
-                    newContext = rootStack[--rootTop];
-                    newContext->data[i] = arg;
-                    if (displayOperators)
-                    {
-                        printf
-                        (
-                            "argument %d in %p is %p\n",
-                            i, newContext, newContext->data[i]
-                        );
-                    }
-                }
-                if (displayFunctions)
-                {
-                    printf
-                    (
-                        "do function (%p) call %s(%p), now do call\n",
-                        currentContext, functionName, code
-                    );
-                }
-                currentContext = newContext;
-                result = evaluateStatement((struct statementRecord*) code);
-                currentContext = currentContext->data[2];
-                if (displayFunctions)
-                {
-                    printf("return from function %s(%p)\n",
-                    functionName, code);
-                }
-            }
-            break;
 
-        case evalThunk:
-            // get the context
-            arg = evaluateExpression(e->u.o.base);
-            undefCheck(19, arg, "thunk");
-            if (displayOperators)
-            {
-                printf("evaluate thunk\n");
-            }
+// -----------------------------------------------------------------------------
+///  Number formatting
+// -----------------------------------------------------------------------------
+//- Used by asString and print for integers and reals.  Buffers must
+//  hold at least 40 characters
 
-            // then evaluate the statement
-            rootStack[rootTop++] = currentContext;
-            currentContext = arg->data[1];
-            result = evaluateStatement((struct statementRecord*) arg->data[2]);
-            currentContext = rootStack[--rootTop];
-            break;
+static const char digitPairs[] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
 
-        case evalReference:
-            arg = evaluateExpression(e->u.o.base);
-            if (displayOperators)
-            {
-                printf("evaluate reference\n");
-            }
-            result = arg->data[0]->data[(int) arg->data[2]];
-            break;
+//- Two digits at a time, from the right
+static int formatInteger(char* buffer, int value)
+{
+    char digits[12];
+    char* p = &digits[12];
+    unsigned int n = (value < 0) ? 0u - (unsigned int) value : value;
 
-        case genIntegerConstant:
-            result = newIntegerConstant(e->u.i.value);
-            if (displayOperators)
-            {
-                printf("make integer constant %d\n", e->u.i.value);
-            }
-            break;
+    while (n >= 100)
+    {
+        unsigned int pair = n % 100;
+        n /= 100;
+        p -= 2;
+        memcpy(p, &digitPairs[2 * pair], 2);
+    }
+    if (n >= 10)
+    {
+        p -= 2;
+        memcpy(p, &digitPairs[2 * n], 2);
+    }
+    else
+    {
+        *--p = '0' + n;
+    }
+    if (value < 0)
+    {
+        *--p = '-';
+    }
 
-        case genStringConstant:
-            result = newStringConstant(e->u.s.value);
-            if (displayOperators)
-            {
-                printf("make string constant %p %s\n", result, e->u.s.value);
-            }
-            break;
+    int length = &digits[12] - p;
+    memcpy(buffer, p, length);
+    buffer[length] = '\0';
 
-        case genRealConstant:
-            result = newRealConstant(e->u.r.value);
-            if (displayOperators)
-            {
-                printf("make real constant %g\n", e->u.r.value);
-            }
-            break;
+    return length;
+}
 
-        case doSpecialCall:
-            if (displayOperators)
-            {
-                printf("do special operator %d\n", e->u.c.index);
-            }
-            result = evaluateSpecial(e->u.c.index, e->u.c.args);
-            break;
 
-        case buildInstance:
-            arg = evaluateExpression(e->u.n.table);
-            rootStack[rootTop++] = arg;
-            result = gcalloc(e->u.n.size);
-            arg = rootStack[--rootTop];
-            undefCheck(20, arg, "build instance table");
-            result->data[0] = arg;
-            result->data[1] = globalContext;
-            if (displayOperators)
-            {
-                printf
-                (
-                    "build an instance %p, size %d table %p\n",
-                    result, e->u.n.size, result->data[0]
-                );
-            }
-            {
-                int max = e->u.n.size;
-                struct list* p = e->u.n.args;
-                int i = 2;
-                for (; p; i++, p = p->next)
-                {
-                    // Tricky gc insurance
-                    if (i > max)
-                    {
-                        yyerror("filling instance too big\n");
-                    }
-                    rootStack[rootTop++] = result;
-                    arg = evaluateExpression
-                    (
-                        (struct expressionRecord*)p->value
-                    );
-                    result = rootStack[--rootTop];
-                    result->data[i] = arg;
-                    if (displayOperators)
-                    {
-                        printf
-                        (
-                            "in instance %p location %d is %p\n",
-                            result, i, result->data[i]
-                        );
-                    }
-                }
-            }
-            break;
+//- As %g.  If exact, more digits are given when six do not read back
+//  as the same float.  Whole numbers that %g shows without an exponent
+//  are written as integers
+static int formatReal(char* buffer, float value, int exact)
+{
+    if
+    (
+        (value > -1e6f) && (value < 1e6f)
+     && (value == (float) (int) value)
+     && !((value == 0) && signbit(value))
+    )
+    {
+        return formatInteger(buffer, (int) value);
+    }
 
-        case commaOp:
-            arg = evaluateExpression(e->u.a.left);
-            // toss away arg
-            result = evaluateExpression(e->u.a.right);
-            break;
+    int length = sprintf(buffer, "%g", value);
+    for
+    (
+        int precision = 7;
+        exact && (precision <= 9) && (strtof(buffer, 0) != value);
+        precision++
+    )
+    {
+        length = sprintf(buffer, "%.*g", precision, value);
+    }
+
+    return length;
+}
+
+
+//- A copy of the formatted text, for a string value
+static char* formattedString(char* buffer, int length)
+{
+    char* p = (char*) malloc(length + 1);
+    if (p == 0)
+    {
+        yyerror("out of memory");
+    }
+    memcpy(p, buffer, length + 1);
+
+    return p;
+}
+
+
+// -----------------------------------------------------------------------------
+///  Random numbers
+// -----------------------------------------------------------------------------
+//- FastRandom (see random.led) keeps the four words of a xoshiro256**
+//  generator in an unboxed block.  Seeds are spread over the state by
+//  splitmix64, and a jump of 2^128 steps splits off a new stream
 
-        case patternMatch:
+static inline uint64_t* randomState(struct ledaValue* block)
+{
+    return (uint64_t*) &block->data[2];
+}
+
+
+static inline uint64_t rotateLeft(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+
+static uint64_t randomNext(uint64_t* s)
+{
+    uint64_t result = rotateLeft(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotateLeft(s[3], 45);
+
+    return result;
+}
+
+
+static void randomSeed(uint64_t* s, int seed)
+{
+    uint64_t x = (uint64_t) (int64_t) seed;
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15u);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+        s[i] = z ^ (z >> 31);
+    }
+}
+
+
+static void randomJump(uint64_t* s)
+{
+    static const uint64_t jump[] =
+    {
+        0x180ec6d33cfd0abau, 0xd5a61266f0c9392cu,
+        0xa9582618e03fc9aau, 0x39abdc4529b1661cu
+    };
+
+    uint64_t t[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            if (jump[i] & ((uint64_t) 1 << b))
             {
-                struct ledaValue* b = evaluateExpression(e->u.p.base);
-                undefCheck(30, b, "pattern base");
-                rootStack[rootTop++] = b;
-                struct ledaValue* a = evaluateExpression(e->u.p.class);
-                undefCheck(30, a, "pattern class");
-                b = rootStack[--rootTop];
-                // get the class of the value
-                arg = b->data[0];
-                result = falseObject;
-                while (1)
+                for (int k = 0; k < 4; k++)
                 {
-                    if (a == arg)
-                    {
-                        result = trueObject;
-                        struct list* p = e->u.p.args;
-                        int i = 2;
-                        while (p)
-                        {
-                            rootStack[rootTop++] = a;
-                            rootStack[rootTop++] = b;
-                            arg = evaluateExpression
-                            (
-                                (struct expressionRecord*) p->value
-                            );
-                            b = rootStack[--rootTop];
-                            a = rootStack[--rootTop];
-                            arg->data[0]->data[(int) arg->data[2]] =
-                                b->data[i++];
-                            p = p->next;
-                        }
-                        break;
-                    }
-                    if (arg == arg->data[4]) break;
-                    arg = arg->data[4];
+                    t[k] ^= s[k];
                 }
             }
-            break;
-
-        default:
-            printf("unimplemented expression type %d\n", e->operator);
-            exit(1);
+            randomNext(s);
+        }
     }
-    return result;
+    memcpy(s, t, sizeof(t));
 }
 
 
-// -----------------------------------------------------------------------------
-///  Evaluate statements
-// -----------------------------------------------------------------------------
+//- Uniform in low to high inclusive, without the bias of a remainder
+static int randomBetween(uint64_t* s, int low, int high)
+{
+    uint64_t range = (uint64_t) ((int64_t) high - low) + 1;
+    uint64_t limit = UINT64_MAX - (UINT64_MAX % range);
+    uint64_t x;
+    do
+    {
+        x = randomNext(s);
+    } while (x >= limit);
+
+    return (int) ((int64_t) low + (int64_t) (x % range));
+}
+
+
+//- Uniform in [0, 1), from the top 24 bits
+static inline float randomUnit(uint64_t* s)
+{
+    return (randomNext(s) >> 40) * (1.0f / 16777216.0f);
+}
+
 
-static struct ledaValue* evaluateStatement
+//- The alias tables of Vose's method for count integer weights held in
+//  slots from start of weights.  Column i is kept with probability[i],
+//  otherwise alias[i] is taken
+static void buildAlias
 (
-    struct statementRecord* st
+    struct ledaValue* weights,
+    int start,
+    int count,
+    float* probability,
+    int* alias
 )
 {
-    register struct statementRecord* s = st;
+    double total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        undefCheck(59, weights->data[start + i], "weight");
+        total += intValue(weights->data[start + i]);
+    }
+    if (total <= 0)
+    {
+        yyerror("weighted choice needs a positive total weight");
+    }
 
-    if (s == 0)
+    double* scaled = (double*) malloc(count * sizeof(double));
+    int* small = (int*) malloc(2 * count * sizeof(int));
+    if ((scaled == 0) || (small == 0))
     {
-        yyerror("internal run-time error: empty statement");
+        yyerror("out of memory");
     }
+    int* large = small + count;
+    int ns = 0;
+    int nl = 0;
 
-    if (rootTop >= ROOTSTACKLIMIT)
+    for (int i = 0; i < count; i++)
     {
-        yyerror("root stack overflow\n");
+        scaled[i] = intValue(weights->data[start + i]) * count / total;
+        if (scaled[i] < 1)
+        {
+            small[ns++] = i;
+        }
+        else
+        {
+            large[nl++] = i;
+        }
     }
 
-    struct ledaValue* result;
+    while (ns && nl)
+    {
+        int l = small[--ns];
+        int g = large[--nl];
+        probability[l] = scaled[l];
+        alias[l] = g;
+        scaled[g] = (scaled[g] + scaled[l]) - 1;
+        if (scaled[g] < 1)
+        {
+            small[ns++] = g;
+        }
+        else
+        {
+            large[nl++] = g;
+        }
+    }
+    while (nl)
+    {
+        int g = large[--nl];
+        probability[g] = 1;
+        alias[g] = g;
+    }
+    while (ns)
+    {
+        int l = small[--ns];
+        probability[l] = 1;
+        alias[l] = l;
+    }
+
+    free(scaled);
+    free(small);
+}
+
 
-    // Store debugging information in case it is needed
-    while (s)
+//- The bounds of a uniform choice, which must not be empty
+static void checkRandomRange(struct ledaValue* low, struct ledaValue* high)
+{
+    undefCheck(56, low, "random lower bound");
+    undefCheck(56, high, "random upper bound");
+    if (intValue(low) > intValue(high))
     {
-        linenumber = s->lineNumber;
-        fileName = s->fileName;
+        yyerror("random range is empty, low is greater than high");
+    }
+}
 
-        // Then do the statement
-        switch(s->statementType)
-        {
-            default:
-                printf("statement type is %d", s->statementType);
-                yyerror("unimplemented statement type");
 
-            case makeLocalsStatement:
-                if (s->u.k.size > 0)
-                {
-                    currentContext->data[3] = gcalloc(s->u.k.size);
-                }
-                else
-                {
-                    currentContext->data[3] = 0;
-                }
-                if (displayOperators)
-                {
-                    printf
-                    (
-                        "Make locals %p size %d\n",
-                        currentContext->data[3], s->u.k.size
-                    );
-                }
-                s = s->next;
-                break;
+//- The cfunctions Leda_random_seed to Leda_random_weighted, given their
+//  evaluated arguments.  The state block comes first, except in
+//  building alias tables, which takes the weights first
+static struct ledaValue* randomOperation(int index, struct ledaValue** args)
+{
+    undefCheck(44, args[0], (index == 65) ? "weights" : "random state");
+    uint64_t* s = randomState(args[0]);
 
-            case expressionStatement:
-                if (displayStatements)
-                {
-                    printf
-                    (
-                        "File %s Line %d: expression statement\n",
-                        s->fileName, s->lineNumber
-                    );
-                }
-                result = evaluateExpression(s->u.r.e);
-                // result should be empty
-                if (result)
-                {
-                    yyerror
-                    (
-                        "internal run-time error: "
-                        "expression statement is non-empty"
-                    );
-                }
-                s = s->next;
-                break;
+    switch (index)
+    {
+        case 59:    // seed: state, seed
+            undefCheck(54, args[1], "random seed");
+            randomSeed(s, intValue(args[1]));
+            break;
 
-            case returnStatement:
-                if (displayOperators)
-                {
-                    printf
-                    (
-                        "File %s Line %d: (%p,%p) Starting return statement\n",
-                        s->fileName, s->lineNumber,
-                        currentContext, currentContext->data[2]
-                    );
-                }
-                if (s->u.r.e)
-                {
-                    result = evaluateExpression(s->u.r.e);
-                }
-                else
-                {
-                    result = 0;
-                }
-                if (displayStatements)
-                {
-                    printf
-                    (
-                        "File %s Line %d: return statement, yields %p\n",
-                        s->fileName, s->lineNumber, result
-                    );
-                }
-                return result;
+        case 60:    // split: state, new state
+            undefCheck(55, args[1], "random state");
+            memcpy(randomState(args[1]), s, 4 * sizeof(uint64_t));
+            randomJump(s);
+            break;
 
-            case tailCall:
-                {
-                    struct ledaValue* code;
-                    struct ledaValue* context;
-                    struct ledaValue* newContext;
-
-                    struct expressionRecord* e =  s->u.r.e;
-                    char* functionName = e->u.f.symbol;
-
-                    if (displayOperators)
-                    {
-                        printf("beginning function call operator\n");
-                    }
-
-                    if (functionName == 0)
-                    {
-                        functionName = " ? ";
-                    }
-
-                    if (e->u.f.fun->operator == makeClosure)
-                    {
-                        if
-                        (
-                            e->u.f.fun->u.l.context->operator
-                         == getCurrentContext
-                        )
-                        {
-                            context = currentContext;
-                        }
-                        else
-                        {
-                            context = evaluateExpression
-                            (
-                                e->u.f.fun->u.l.context
-                            );
-                            undefCheck(15, context,"context");
-                        }
-                        code = (struct ledaValue*)e->u.f.fun->u.l.code;
-                    }
-                    else if (e->u.f.fun->operator == makeMethodContext)
-                    {
-                        context = evaluateExpression(e->u.f.fun->u.o.base);
-                        undefCheck(16, context,"context");
-                        undefCheck(17, context->data[0],"method table");
-                        code =
-                            (context->data[0])->data[e->u.f.fun->u.o.location];
-                    }
-                    else
-                    {
-                        struct ledaValue* arg = evaluateExpression(e->u.f.fun);
-                        undefCheck(18, arg, e->u.f.symbol);
-                        context = arg->data[1];
-                        code = arg->data[2];
-                    }
-
-                    // create the activation record
-                    struct list* p = e->u.f.args;
-
-                    rootStack[rootTop++] = context;
-                    newContext = gcalloc(length(p) + 4);
-                    context = rootStack[--rootTop];
-                    if (displayOperators)
-                    {
-                        printf
-                        (
-                            "do tail call fun context %p, "
-                            "new context %p args:\n",
-                            context, newContext
-                        );
-                    }
-                    newContext->data[1] = context;
-                    newContext->data[2] = currentContext->data[2];
-                    for (int i=4 ; p ; i++,p = p->next)
-                    {
-                        // tricky gc insurance
-                        rootStack[rootTop++] = newContext;
-                        struct ledaValue* arg = evaluateExpression
-                        (
-                            (struct expressionRecord*)p->value
-                        );
-                        newContext = rootStack[--rootTop];
-                        newContext->data[i] = arg;
-                        if (displayOperators)
-                        {
-                            printf
-                            (
-                                "argument %d in %p is %p\n",
-                                i, newContext, newContext->data[i]
-                            );
-                        }
-                    }
-                    if (displayFunctions)
-                    {
-                        printf
-                        (
-                            "tail function call %s(%p), now do call\n",
-                            functionName, code
-                        );
-                    }
-                    currentContext = newContext;
-                    s = (struct statementRecord*) code;
-                }
-                break;
+        case 61:    // integer: state, low, high
+            checkRandomRange(args[1], args[2]);
+            return newIntegerConstant
+            (
+                randomBetween(s, intValue(args[1]), intValue(args[2]))
+            );
 
-            case conditionalStatement:
-                if (displayStatements)
+        case 62:    // real: state
+            return newRealConstant(randomUnit(s));
+
+        case 63:    // fill integers: state, block, count, low, high
+            undefCheck(57, args[1], "random block");
+            undefCheck(58, args[2], "random count");
+            checkRandomRange(args[3], args[4]);
+            {
+                int* x = intCells(args[1]);
+                int n = intValue(args[2]);
+                int low = intValue(args[3]);
+                int high = intValue(args[4]);
+                for (int i = 0; i < n; i++)
                 {
-                    printf
-                    (
-                        "File %s Line %d: conditional statement\n",
-                        s->fileName, s->lineNumber
-                    );
+                    x[i] = randomBetween(s, low, high);
                 }
-                result = evaluateExpression(s->u.c.expr);
-                if (result == trueObject)
+            }
+            break;
+
+        case 64:    // fill reals: state, block, count
+            undefCheck(57, args[1], "random block");
+            undefCheck(58, args[2], "random count");
+            {
+                float* x = realCells(args[1]);
+                int n = intValue(args[2]);
+                for (int i = 0; i < n; i++)
                 {
-                    s = s->next;
+                    x[i] = randomUnit(s);
                 }
-                else
+            }
+            break;
+
+        case 65:    // build alias: weights, start, count, probability, alias
+            undefCheck(58, args[1], "weights start");
+            undefCheck(58, args[2], "weights count");
+            undefCheck(57, args[3], "alias probabilities");
+            undefCheck(57, args[4], "alias table");
+            buildAlias
+            (
+                args[0],
+                intValue(args[1]),
+                intValue(args[2]),
+                realCells(args[3]),
+                intCells(args[4])
+            );
+            break;
+
+        case 66:    // weighted: state, probability, alias, count
+            undefCheck(57, args[1], "alias probabilities");
+            undefCheck(57, args[2], "alias table");
+            undefCheck(58, args[3], "weights count");
+            {
+                int i = randomBetween(s, 0, intValue(args[3]) - 1);
+                if (randomUnit(s) >= realCells(args[1])[i])
                 {
-                    s = s->u.c.falsePart;
+                    i = intCells(args[2])[i];
                 }
-                break;
-
-            case nullStatement:
-                s = s->next;
-                break;
-        };
-    };
+                return newIntegerConstant(i);
+            }
+    }
 
     return 0;
 }
 
 
+// -----------------------------------------------------------------------------
+///  Evaluators
+// -----------------------------------------------------------------------------
+//- The production evaluator is compiled with the tracing removed,
+//  the traced evaluator is used only when a display switch is given
+
+#define TRACE 0
+#include "evaluate.h"
+#undef TRACE
+
+#define TRACE 1
+#define evaluateSpecial tracedEvaluateSpecial
+#define evaluateExpression tracedEvaluateExpression
+#define evaluateStatement tracedEvaluateStatement
+#define applyFunction tracedApplyFunction
+#define sortLess tracedSortLess
+#define sortSlots tracedSortSlots
+#define heapCell tracedHeapCell
+#define heapLess tracedHeapLess
+#define heapSwap tracedHeapSwap
+#define heapSiftUp tracedHeapSiftUp
+#define heapSiftDown tracedHeapSiftDown
+#include "evaluate.h"
+#undef evaluateSpecial
+#undef evaluateExpression
+#undef evaluateStatement
+#undef applyFunction
+#undef sortLess
+#undef sortSlots
+#undef heapCell
+#undef heapLess
+#undef heapSwap
+#undef heapSiftUp
+#undef heapSiftDown
+#undef TRACE
+
+
 // Fix up the metaclass information on class objects
 // can only be done once global variables have been defined
 
@@ -1327,6 +1172,207 @@ static void fixClassTable
 }
 
 
+//- Values held by the interpreter outside of static memory that are
+//  saved in program images.  The string class must come first, it is
+//  how images tell strings from other binary values
+static struct ledaValue** imageRoots[] =
+{
+    &stringClass, &globalContext, &integerClass, &realClass,
+    &trueObject, &trueClass, &falseObject, &falseClass,
+    &integerTable[0], &integerTable[1], &integerTable[2], &integerTable[3],
+    &integerTable[4], &integerTable[5], &integerTable[6], &integerTable[7],
+    &integerTable[8], &integerTable[9], &integerTable[10], &integerTable[11],
+    &integerTable[12], &integerTable[13], &integerTable[14],
+    &integerTable[15], &integerTable[16], &integerTable[17],
+    &integerTable[18], &integerTable[19],
+    0
+};
+
+
+//- Folded values are shared by class and value, so each distinct literal
+//  takes a single block of static memory however often it is written.
+//  Reals are told apart by their bits, keeping -0.0 distinct from 0.0
+# define FOLDEDBUCKETS 1024
+
+static struct list* foldedValues[FOLDEDBUCKETS];
+
+static struct ledaValue* foldedInteger(int i)
+{
+    struct list** bucket = &foldedValues[(unsigned int) i % FOLDEDBUCKETS];
+    for (struct list* p = *bucket; p; p = p->next)
+    {
+        struct ledaValue* v = (struct ledaValue*) p->value;
+        if ((v->data[0] == integerClass) && (intValue(v) == i))
+        {
+            return v;
+        }
+    }
+
+    struct ledaValue* v = newIntegerConstant(i);
+    *bucket = newList((char*) v, *bucket);
+    return v;
+}
+
+
+static struct ledaValue* foldedReal(float r)
+{
+    unsigned int bits = 0;
+    memcpy(&bits, &r, sizeof(float));
+    struct list** bucket = &foldedValues[bits % FOLDEDBUCKETS];
+    for (struct list* p = *bucket; p; p = p->next)
+    {
+        struct ledaValue* v = (struct ledaValue*) p->value;
+        float f = realValue(v);
+        if ((v->data[0] == realClass) && (memcmp(&f, &r, sizeof(float)) == 0))
+        {
+            return v;
+        }
+    }
+
+    struct ledaValue* v = newRealConstant(r);
+    *bucket = newList((char*) v, *bucket);
+    return v;
+}
+
+
+static struct ledaValue* foldedString(char* text)
+{
+    struct list** bucket = &foldedValues[stringHash(text) % FOLDEDBUCKETS];
+    for (struct list* p = *bucket; p; p = p->next)
+    {
+        struct ledaValue* v = (struct ledaValue*) p->value;
+        if
+        (
+            (v->data[0] == stringClass)
+         && (strcmp((char*) v->data[2], text) == 0)
+        )
+        {
+            return v;
+        }
+    }
+
+    struct ledaValue* v = newStringConstant(text);
+    *bucket = newList((char*) v, *bucket);
+    return v;
+}
+
+
+//- The shared value equal to the result of a folded cfunction
+static struct ledaValue* foldedValue(struct ledaValue* v)
+{
+    if (v->data[0] == integerClass)
+    {
+        return foldedInteger(intValue(v));
+    }
+    if (v->data[0] == realClass)
+    {
+        return foldedReal(realValue(v));
+    }
+    if (v->data[0] == stringClass)
+    {
+        return foldedString((char*) v->data[2]);
+    }
+    return v;
+}
+
+
+//- Literals, and the cfunctions that depend only upon their arguments
+//  when given literals, are evaluated once into static memory.
+//  Division is left for run time when it would fail.
+static int foldableSpecial(struct expressionRecord* e)
+{
+    switch(e->u.c.index)
+    {
+        case 8:     // integer division
+            return intValue(e->u.c.args[1]->u.v.value) != 0;
+
+        case 1: case 3: case 4: case 5: case 6: case 7:
+        case 10: case 11: case 12: case 13: case 14: case 19:
+        case 24: case 25: case 26: case 27: case 28: case 29: case 30:
+        case 31:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+
+static void foldConstant(struct expressionRecord* e)
+{
+    switch(e->operator)
+    {
+        case genIntegerConstant:
+            e->u.v.value = foldedInteger(e->u.i.value);
+            break;
+
+        case genStringConstant:
+            e->u.v.value = foldedString(e->u.s.value);
+            break;
+
+        case genRealConstant:
+            e->u.v.value = foldedReal(e->u.r.value);
+            break;
+
+        case doSpecialCall:
+            for (int i = 0; i < e->u.c.nargs; i++)
+            {
+                struct expressionRecord* a = e->u.c.args[i];
+                if (a->operator == checkDefined)
+                {
+                    a = a->u.o.base;
+                }
+                foldConstant(a);
+                if (a->operator != loadConstant)
+                {
+                    return;
+                }
+                e->u.c.args[i] = a;
+            }
+            if (!foldableSpecial(e))
+            {
+                return;
+            }
+            e->u.v.value = foldedValue
+            (
+                evaluateSpecial(e->u.c.index, e->u.c.nargs, e->u.c.args)
+            );
+            break;
+
+        default:
+            return;
+    }
+
+    e->operator = loadConstant;
+}
+
+
+static void foldConstants(void)
+{
+    for (struct list* p = foldCandidates; p; p = p->next)
+    {
+        foldConstant((struct expressionRecord*) p->value);
+    }
+}
+
+
+static void executeProgram(struct statementRecord* firstStatement)
+{
+    doingInitialization = 0;
+    currentContext = globalContext;
+    if (displayFunctions || displayStatements || displayOperators)
+    {
+        tracedEvaluateStatement(firstStatement);
+    }
+    else
+    {
+        evaluateStatement(firstStatement);
+    }
+
+    printf("\nexecution ended normally\n");
+}
+
+
 void beginInterpreter
 (
     struct symbolTableRecord* syms,
@@ -1441,12 +1487,33 @@ void beginInterpreter
         }
     }
 
+    // The traced evaluator shows every call as written, but literals are
+    // folded in both, so that == on them does not depend upon tracing
+    if (!(displayFunctions || displayStatements || displayOperators))
+    {
+        inlinePrimitives(syms);
+    }
+    foldConstants();
+
+    if (imageFileName)
+    {
+        saveImage(imageFileName, imageRoots, firstStatement);
+    }
+
     // now start execution
-    doingInitialization = 0;
-    currentContext = globalContext;
-    a = evaluateStatement(firstStatement);
+    executeProgram(firstStatement);
+}
 
-    printf("\nexecution ended normally\n");
+
+//- Runs a program saved by -save-image, in place of parsing it.
+//  The sizes are those given on the command line; static memory is grown to
+//  fit the image if it was saved with a larger -s
+void beginImage(char* name, int staticsz, int dynamicsz, int framesz)
+{
+    struct statementRecord* first =
+        loadImage(name, imageRoots, staticsz, dynamicsz, framesz);
+    printf("image loaded, starting execution\n");
+    executeProgram(first);
 }
 
 
@@ -31,12 +31,13 @@ extern struct typeRecord* falseType;
 
 enum statements
 {
-    makeLocalsStatement,
+    functionEntryStatement,
     expressionStatement,
     returnStatement,
     conditionalStatement,
     nullStatement,
     tailCall,
+    countedLoopStatement,
 };
 
 struct statementRecord
@@ -53,13 +54,22 @@ struct statementRecord
             struct expressionRecord* expr;
             struct statementRecord* falsePart;
         } c;
+        struct     // counted loop test, falsePart is the loop exit
+        {
+            struct expressionRecord* expr;      // general test
+            struct statementRecord* falsePart;
+            struct expressionRecord* counter;
+            struct expressionRecord* limit;
+        } l;
         struct     // procedure call, return
         {
             struct expressionRecord* e;
         } r;
-        struct      // make locals
+        struct      // function entry
         {
-            int size;
+            int size;       // arguments and locals in the activation record
+            int escapes;    // context cannot live on the frame stack
+            int primitive;  // body only returns the result of a cfunction
         } k;
     } u;
 };
@@ -116,6 +126,11 @@ struct statementRecord* genBody
     struct statementRecord*
 );
 
+void inlinePrimitives(struct symbolTableRecord*);
+
+// Literals and cfunction calls that foldConstants may evaluate
+extern struct list* foldCandidates;
+
 
 // -----------------------------------------------------------------------------
 ///  Expressions
@@ -140,8 +155,18 @@ enum instructions
     buildInstance,
     commaOp,
     patternMatch,
+
+    // Fused instructions, selected once a body is complete
+    getLocal,           // getOffset of current context
+    getSelfField,       // getOffset of self, local 1
+    assignLocal,        // assignment to a local
+    assignSelfField,    // assignment to a field of self
+    checkDefined,       // receiver of an inlined primitive method
+    loadConstant,       // value computed before the program is run
 };
 
+struct ledaValue;
+
 struct expressionRecord
 {
     enum instructions operator;
@@ -165,7 +190,8 @@ struct expressionRecord
         struct     // do special
         {
             int index;
-            struct list* args;
+            int nargs;
+            struct expressionRecord** args;
         } c;
 
         struct      // make closure
@@ -179,7 +205,8 @@ struct expressionRecord
         {
             struct expressionRecord* fun;
             char* symbol;
-            struct list* args;
+            int nargs;
+            struct expressionRecord** args;
         } f;
 
         struct      // genIntegerConstant
@@ -197,23 +224,31 @@ struct expressionRecord
             double value;
         } r;
 
+        struct      // loadConstant
+        {
+            struct ledaValue* value;
+        } v;
+
         struct      // buildInstance
         {
             struct expressionRecord* table;
             int size;
-            struct list* args;
+            int nargs;
+            struct expressionRecord** args;
         } n;
 
         struct      // pattern match
         {
             struct expressionRecord* base;
             struct expressionRecord* class;
-            struct list* args;
+            int nargs;
+            struct expressionRecord** args;
         } p;
     } u;
 };
 
 struct expressionRecord* newExpression(enum instructions);
+struct expressionRecord** argumentArray(struct list*, int*);
 
 extern char* specialFunctionNames[];
 
@@ -325,6 +360,24 @@ struct expressionRecord* genPatternMatch
 void buildClassTable(struct symbolRecord*);
 
 void beginInterpreter(struct symbolTableRecord*, struct statementRecord*);
+void beginImage(char*, int, int, int);
+
+extern char* imageFileName;
+
+
+// -----------------------------------------------------------------------------
+///  Program images
+// -----------------------------------------------------------------------------
+
+void saveImage(char*, struct ledaValue**[], struct statementRecord*);
+struct statementRecord* loadImage
+(
+    char*,
+    struct ledaValue**[],
+    int,
+    int,
+    int
+);
 
 
 // -----------------------------------------------------------------------------
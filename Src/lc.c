@@ -15,7 +15,7 @@
 #include "interp.h"
 #include <string.h>
 #include <stdio.h>
-#include <malloc.h>
+#include <stdlib.h>
 
 struct typeRecord* objectType;
 struct typeRecord* booleanType;
@@ -31,16 +31,56 @@ struct typeRecord* ClassType;
 extern int linenumber;
 
 // -----------------------------------------------------------------------------
-///  Lists
+///  Compiler memory
 // -----------------------------------------------------------------------------
+//- The arena is a chain of large blocks, allocated from in order, so
+//  records built together (such as the code of one function) are
+//  also together in memory.  Large requests get a block of their own
 
-struct list* newList(char* v, struct list* ol)
+# define ARENABLOCK 65536
+# define ARENAALIGN ((int) sizeof(double))
+
+static char* arenaPointer = 0;
+static char* arenaTop = 0;
+
+void* compilerAllocate(int size)
 {
-    struct list* nl = (struct list*) malloc(sizeof(struct list));
-    if (nl == 0)
+    size = (size + ARENAALIGN - 1) & ~(ARENAALIGN - 1);
+
+    if (size > arenaTop - arenaPointer)
     {
-        yyerror("out of memory for compiler");
+        if (size > ARENABLOCK/4)
+        {
+            void* p = calloc(1, size);
+            if (p == 0)
+            {
+                yyerror("out of memory for compiler");
+            }
+            return p;
+        }
+
+        arenaPointer = (char*) calloc(1, ARENABLOCK);
+        if (arenaPointer == 0)
+        {
+            yyerror("out of memory for compiler");
+        }
+        arenaTop = arenaPointer + ARENABLOCK;
     }
+
+    void* p = arenaPointer;
+    arenaPointer += size;
+
+    return p;
+}
+
+
+// -----------------------------------------------------------------------------
+///  Lists
+// -----------------------------------------------------------------------------
+
+struct list* newList(char* v, struct list* ol)
+{
+    struct list* nl = compilerNew(struct list);
     nl->value = v;
     nl->next = ol;
 
@@ -83,12 +123,7 @@ struct symbolTableRecord* newSymbolTable
     struct symbolTableRecord* ctx
 )
 {
-    struct symbolTableRecord* nctx =
-        (struct symbolTableRecord*)malloc(sizeof(struct symbolTableRecord));
-    if (nctx == 0)
-    {
-        yyerror("out of memory for compiler");
-    }
+    struct symbolTableRecord* nctx = compilerNew(struct symbolTableRecord);
     nctx->surroundingContext = ctx;
     nctx->size = 0;
     nctx->firstSymbol = 0;
@@ -98,6 +133,8 @@ struct symbolTableRecord* newSymbolTable
     switch(tt)
     {
         case globals:
+            nctx->u.g.names = (struct list**)
+                compilerAllocate(NAMEINDEXSIZE*sizeof(struct list*));
             break;
 
         case functionTable:
@@ -115,13 +152,39 @@ struct symbolTableRecord* newSymbolTable
 }
 
 
+static int nameIndex(char* name)
+{
+    unsigned int h = 0;
+    for (; *name; name++)
+    {
+        h = 31*h + (unsigned char) *name;
+    }
+
+    return h % NAMEINDEXSIZE;
+}
+
+
+//- A list holding, amongst others, every symbol in syms with the given
+//  name, most recently added first.
+//  The global table, which is by far the largest, is indexed by name
+struct list* symbolsNamed(struct symbolTableRecord* syms, char* name)
+{
+    if (syms->ttype == globals)
+    {
+        return syms->u.g.names[nameIndex(name)];
+    }
+
+    return syms->firstSymbol;
+}
+
+
 struct symbolRecord* lookupLocal
 (
     struct symbolTableRecord* syms,
     char* name
 )
 {
-    for (struct list* p = syms->firstSymbol; p; p = p->next)
+    for (struct list* p = symbolsNamed(syms, name); p; p = p->next)
     {
         struct symbolRecord* s = (struct symbolRecord*) p->value;
         if (strcmp(name, s->name) == 0)
@@ -176,6 +239,12 @@ struct symbolRecord* lookupSymbol
 void addNewSymbol(struct symbolTableRecord* syms, struct symbolRecord* s)
 {
     syms->firstSymbol = newList((char*) s, syms->firstSymbol);
+
+    if (syms->ttype == globals)
+    {
+        struct list** names = &syms->u.g.names[nameIndex(s->name)];
+        *names = newList((char*) s, *names);
+    }
 }
 
 
@@ -185,12 +254,7 @@ void addNewSymbol(struct symbolTableRecord* syms, struct symbolRecord* s)
 
 struct symbolRecord* newSymbolRecord(char* n, enum symbolTypes st)
 {
-    struct symbolRecord* p =
-        (struct symbolRecord*)malloc(sizeof(struct symbolRecord));
-    if (p == 0)
-    {
-        yyerror("out of memory");
-    }
+    struct symbolRecord* p = compilerNew(struct symbolRecord);
     p->name = n;
     p->styp = st;
 
@@ -198,6 +262,18 @@ struct symbolRecord* newSymbolRecord(char* n, enum symbolTypes st)
 }
 
 
+//- In a function the locals follow the arguments in the activation record
+static int newLocation(struct symbolTableRecord* syms)
+{
+    if (syms->ttype == functionTable)
+    {
+        return syms->u.f.argumentLocation + syms->size++;
+    }
+
+    return syms->size++;
+}
+
+
 void addConstant
 (
     struct symbolTableRecord* syms,
@@ -215,7 +291,7 @@ void addConstant
     uniqueName(syms, name);
 
     s->u.s.val = value;
-    s->u.s.location = syms->size++;
+    s->u.s.location = newLocation(syms);
     s->u.s.typ = newConstantType(value->resultType);
     s->u.s.lineNumber = linenumber;
     addNewSymbol(syms, s);
@@ -233,7 +309,7 @@ struct symbolRecord* addVariable
     uniqueName(syms, name);
 
     s->u.v.typ = typ;
-    s->u.v.location = syms->size++;
+    s->u.v.location = newLocation(syms);
     addNewSymbol(syms, s);
 
     return s;
@@ -265,14 +341,7 @@ struct argumentRecord* newArgument
     enum forms f
 )
 {
-    struct argumentRecord* a =
-        (struct argumentRecord*) malloc(sizeof(struct argumentRecord));
-
-    if (a == 0)
-    {
-        yyerror("out of memory for compiler");
-    }
-
+    struct argumentRecord* a = compilerNew(struct argumentRecord);
     a->name = n;
     a->theType = t;
     a->stform = f;
@@ -371,6 +440,7 @@ void fillInParent
 
     // first just set the parent field
     theClass->u.c.parent = theParent;
+    forgetConformance();
     struct typeRecord* u = 0;
 
     // Now fill in the qualified type, if necessary
@@ -459,7 +529,7 @@ struct symbolTableRecord* addFunctionSymbol
         {
             case functionTable:
             case globals:
-                fs->u.f.location = syms->size++;
+                fs->u.f.location = newLocation(syms);
                 addNewSymbol(syms, fs);
                 break;
 
@@ -32,6 +32,17 @@ struct list* newList(char*, struct list*);
 struct list* reverse(struct list*);
 
 
+// -----------------------------------------------------------------------------
+///  Compiler memory
+// -----------------------------------------------------------------------------
+//- Records built by the compiler are never freed.
+//  They are allocated, zero filled, from an arena
+
+void* compilerAllocate(int);
+
+# define compilerNew(type) ((type*) compilerAllocate(sizeof(type)))
+
+
 // -----------------------------------------------------------------------------
 ///  Symbol Tables
 // -----------------------------------------------------------------------------
@@ -120,6 +131,11 @@ struct symbolTableRecord
 
     union
     {
+        struct         // the global table
+        {
+            struct list** names;    // symbols hashed by name
+        } g;
+
         struct         //  function tables
         {
             struct symbolRecord* theFunctionSymbol;
@@ -151,6 +167,9 @@ struct symbolRecord* addVariable
 
 void addNewSymbol(struct symbolTableRecord*, struct symbolRecord*);
 
+# define NAMEINDEXSIZE 509
+struct list* symbolsNamed(struct symbolTableRecord*, char*);
+
 struct symbolRecord* lookupSymbol(struct symbolTableRecord*, char*);
 
 struct symbolTableRecord* addFunctionSymbol
@@ -345,6 +364,7 @@ void fillInParent
 );
 
 int typeConformable(struct typeRecord* a, struct typeRecord* b);
+void forgetConformance(void);
 
 int length(struct list* p);
 
@@ -47,9 +47,8 @@ static int inSpaceOne;
 static struct ledaValue* oldBase;
 static struct ledaValue* oldTop;
 
-void dbaddr(int addr, int offset)
+void dbaddr(struct ledaValue* t, int offset)
 {
-    struct ledaValue* t = (struct ledaValue*) addr;
     printf("DB offset %d in %p is %p\n", offset, t, t->data[offset]);
 }
 
@@ -64,28 +63,42 @@ struct ledaValue* globalContext;
 struct ledaValue* currentContext;
 
 
+// -----------------------------------------------------------------------------
+///  Frame stack
+// -----------------------------------------------------------------------------
+
+struct ledaValue* frameBase;
+struct ledaValue* framePointer;
+struct ledaValue* frameTop;
+
+
 // -----------------------------------------------------------------------------
 ///  gcinit
 // -----------------------------------------------------------------------------
 //- Initialize the memory management system
 
-void gcinit(int staticsz, int dynamicsz)
+void gcinit(int staticsz, int dynamicsz, int framesz)
 {
-    // Should do something better than this, but  ...
-    if (sizeof(int) != sizeof(struct  ledaValue*))
+    // Integers and reals are stored in the space of a pointer
+    if (sizeof(int) > sizeof(struct ledaValue*))
     {
-        yyerror("pointers not same size as ints");
+        yyerror("ints do not fit in the space of a pointer");
     }
-    if (sizeof(float) != sizeof(struct ledaValue*))
+    if (sizeof(float) > sizeof(struct ledaValue*))
     {
-        yyerror("floats not same size as pointers");
+        yyerror("floats do not fit in the space of a pointer");
     }
 
     // Allocate the memory areas
     staticBase = (struct ledaValue*)malloc(staticsz*sizeof(struct ledaValue));
     spaceOne = (struct ledaValue*)malloc(dynamicsz*sizeof(struct ledaValue));
     spaceTwo = (struct ledaValue*)malloc(dynamicsz*sizeof(struct ledaValue));
-    if ((staticBase == 0) || (spaceOne == 0) || (spaceTwo == 0))
+    frameBase = (struct ledaValue*)malloc(framesz*sizeof(struct ledaValue));
+    if
+    (
+        (staticBase == 0) || (spaceOne == 0)
+     || (spaceTwo == 0) || (frameBase == 0)
+    )
     {
         fprintf(stderr,"not enough memory for space allocations\n");
         exit(1);
@@ -94,6 +107,9 @@ void gcinit(int staticsz, int dynamicsz)
     staticTop = staticBase + staticsz;
     staticPointer = staticTop;
 
+    framePointer = frameBase;
+    frameTop = frameBase + framesz;
+
     spaceSize = dynamicsz;
     memoryBase = spaceOne;
     memoryPointer = memoryBase + spaceSize;
@@ -282,6 +298,18 @@ struct ledaValue* gcollect(int sz)
     {
         rootStack[i] = gc_move(rootStack[i]);
     }
+
+    // Frames on the stack stay where they are, but their contents move
+    for (struct ledaValue* p = frameBase; p < framePointer;)
+    {
+        int fsz = p->size >> 2;
+        for (int i = 0; i < fsz; i++)
+        {
+            p->data[i] = gc_move(p->data[i]);
+        }
+        p += fsz + 1;
+    }
+
     if (displayOperators)
     {
         printf("finished gc\n");
@@ -302,7 +330,10 @@ struct ledaValue* gcollect(int sz)
 // -----------------------------------------------------------------------------
 ///  staticAllocate
 // -----------------------------------------------------------------------------
-//- Allocates values not be subject to garbage collection
+//- Allocates values not be subject to garbage collection.
+//  Values are zero filled, including the spare slot following the
+//  last, so that slots never assigned can be told from code pointers
+//  when a program image is written
 
 struct ledaValue* staticAllocate(int sz)
 {
@@ -312,6 +343,19 @@ struct ledaValue* staticAllocate(int sz)
         yyerror("insufficient static memory");
     }
     staticPointer->size = sz << 2;
+    for (int i = 0; i <= sz; i++)
+    {
+        staticPointer->data[i] = 0;
+    }
+
+    return staticPointer;
+}
+
+
+//- The region of static memory allocated so far, for program images
+struct ledaValue* staticInUse(int* units)
+{
+    *units = staticTop - staticPointer;
 
     return staticPointer;
 }
@@ -26,6 +26,11 @@
 //    which is not ever garbage collected.
 //    The only pointer from static memory back to dynamic memory is
 //    the global context.
+//
+//    Activation records that the compiler can show never escape
+//    are allocated on a separate frame stack, released when the
+//    function returns.  Frames on the stack are traced, but
+//    never moved, during garbage collection.
 // -----------------------------------------------------------------------------
 
 #ifndef memory_h
@@ -62,13 +67,26 @@ extern struct ledaValue* globalContext;
 extern struct ledaValue* currentContext;
 
 
+// -----------------------------------------------------------------------------
+///  Frame stack
+// -----------------------------------------------------------------------------
+//- framePointer is the first free location, the stack grows upward
+
+extern struct ledaValue* frameBase;
+extern struct ledaValue* framePointer;
+extern struct ledaValue* frameTop;
+
+# define inFrameStack(p) (((p) >= frameBase) && ((p) < frameTop))
+
+
 // -----------------------------------------------------------------------------
 ///  entry points
 // -----------------------------------------------------------------------------
 
-void gcinit(int, int);
+void gcinit(int, int, int);
 struct ledaValue* gcollect(int);
 struct ledaValue* staticAllocate(int);
+struct ledaValue* staticInUse(int*);
 
 # define gcalloc(sz) (((memoryPointer-=((sz)+2))<memoryBase)?                  \
     gcollect(sz):(memoryPointer->size=(sz)<<2,memoryPointer))
@@ -79,6 +97,23 @@ struct ledaValue* staticAllocate(int);
 
 int yyerror(char* s);
 
+//- Frames are zero filled, so that the collector never sees stale values
+static inline struct ledaValue* framealloc(int sz)
+{
+    struct ledaValue* frame = framePointer;
+    framePointer += sz + 1;
+    if (framePointer > frameTop)
+    {
+        yyerror("frame stack overflow");
+    }
+    frame->size = sz << 2;
+    for (int i = 0; i < sz; i++)
+    {
+        frame->data[i] = 0;
+    }
+    return frame;
+}
+
 
 // -----------------------------------------------------------------------------
 #endif // memory_h
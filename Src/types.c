@@ -13,7 +13,6 @@
 
 #include "lc.h"
 #include <stdio.h>
-#include <malloc.h>
 
 struct typeRecord* newConstantType(struct typeRecord* b)
 {
@@ -200,14 +199,7 @@ struct symbolRecord* argumentNumber(struct typeRecord* t, int n)
 
 struct typeRecord* newTypeRecord(enum typeForms tt)
 {
-    struct typeRecord* t =
-        (struct typeRecord*)malloc(sizeof(struct typeRecord));
-
-    if (t == 0)
-    {
-        yyerror("out of memory");
-    }
-
+    struct typeRecord* t = compilerNew(struct typeRecord);
     t->ttyp = tt;
 
     switch(tt)
@@ -327,6 +319,56 @@ static int functionTypeConformable
 }
 
 
+// -----------------------------------------------------------------------------
+///  Conformance of classes
+// -----------------------------------------------------------------------------
+//- Whether one class conforms to another depends only upon the chain of
+//  parents, so answers are remembered until a parent is filled in
+
+# define CONFORMCACHESIZE 4096
+
+static struct
+{
+    struct typeRecord* a;
+    struct typeRecord* b;
+    int generation;
+    int result;
+} conformCache[CONFORMCACHESIZE];
+
+static int conformGeneration = 1;
+
+void forgetConformance(void)
+{
+    conformGeneration++;
+}
+
+static int classConformable(struct typeRecord* a, struct typeRecord* b)
+{
+    unsigned long h =
+        (((unsigned long) a >> 3) * 31 + ((unsigned long) b >> 3))
+      % CONFORMCACHESIZE;
+
+    if
+    (
+        (conformCache[h].generation == conformGeneration)
+     && (conformCache[h].a == a)
+     && (conformCache[h].b == b)
+    )
+    {
+        return conformCache[h].result;
+    }
+
+    int result = typeConformable(a, b->u.c.parent);
+
+    conformCache[h].a = a;
+    conformCache[h].b = b;
+    conformCache[h].generation = conformGeneration;
+    conformCache[h].result = result;
+
+    return result;
+}
+
+
 int typeConformable(struct typeRecord* a, struct typeRecord* b)
 {
     if (a == b) return 1;
@@ -372,7 +414,7 @@ int typeConformable(struct typeRecord* a, struct typeRecord* b)
             {
                 if (a == b) return 1;
                 if (b == b->u.c.parent) return 0;
-                return typeConformable(a, b->u.c.parent);
+                return classConformable(a, b);
             }
             else if (b->ttyp == qualifiedType)
             {